@@ -0,0 +1,106 @@
+//
+// The face detection running in the background of the capture loop
+//
+
+#include "AsyncDetector.h"
+
+AsyncDetector::AsyncDetector(std::shared_ptr<const MTCNNModel> model, cv::Size frame_size)
+        : mtcnn_(model), frame_size_(frame_size)
+{
+    thread_ = std::thread(&AsyncDetector::run, this);
+}
+
+AsyncDetector::~AsyncDetector()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_one();
+    thread_.join();
+}
+
+bool AsyncDetector::submit(const cv::Mat& img, int frame_id)
+{
+    return submit(img, frame_id, std::vector<cv::Rect>());
+}
+
+bool AsyncDetector::submit(const cv::Mat& img, int frame_id, const std::vector<cv::Rect>& regions)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(busy_)
+            return false;
+
+        //the frame is copied, the capture loop reuses its buffer
+        img.copyTo(frame_);
+        frame_id_ = frame_id;
+        regions_ = regions;
+        pending_ = true;
+        busy_ = true;
+    }
+    condition_.notify_one();
+    return true;
+}
+
+bool AsyncDetector::poll(std::vector<cv::Rect>& rectangles, int& frame_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!ready_)
+        return false;
+
+    rectangles.swap(rectangles_);
+    frame_id = frame_id_;
+    ready_ = false;
+    busy_ = false;
+    return true;
+}
+
+bool AsyncDetector::busy()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return busy_;
+}
+
+void AsyncDetector::run()
+{
+    //the mode of caffe is kept per thread
+    #ifdef CPU_ONLY
+        Caffe::set_mode(Caffe::CPU);
+    #else
+        Caffe::set_mode(Caffe::GPU);
+    #endif
+
+    //the first frames do not wait for the blobs
+    if(frame_size_.area() > 0)
+        mtcnn_.warm_up(frame_size_);
+
+    cv::Mat frame;
+    std::vector<cv::Rect> regions;
+    std::vector<cv::Rect> rectangles;
+
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock, [this]{ return pending_ || stop_; });
+            if(stop_)
+                break;
+
+            std::swap(frame, frame_);
+            regions.swap(regions_);
+            pending_ = false;
+        }
+
+        if(regions.empty())
+            mtcnn_.detection(frame, rectangles);
+        else
+            mtcnn_.detection_ROI(frame, regions, rectangles);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            rectangles_ = rectangles;
+            ready_ = true;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+//
+// The face detection running in the background of the capture loop
+//
+
+#ifndef MTCNN_ASYNCDETECTOR_H
+#define MTCNN_ASYNCDETECTOR_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "MTCNN.h"
+
+/*
+ * AsyncDetector is used to detect the faces of a frame in a worker thread, so the capture loop never waits
+ * for MTCNN. One frame is in flight at a time, the result is polled with the id of the frame it belongs to,
+ * and the caller moves the boxes to its current frame.
+ */
+class AsyncDetector {
+
+public:
+
+    //the nets are planned for the frames of frame_size in the worker thread, if the size is given
+    AsyncDetector(std::shared_ptr<const MTCNNModel> model, cv::Size frame_size = cv::Size());
+    ~AsyncDetector();
+
+    //submit a frame to the worker, false if the last frame has not been polled yet
+    bool submit(const cv::Mat& img, int frame_id);
+
+    //submit a frame to be searched around the regions only, the whole frame is searched if there is no region
+    bool submit(const cv::Mat& img, int frame_id, const std::vector<cv::Rect>& regions);
+
+    //get the faces of the submitted frame, false if the worker has not finished it
+    bool poll(std::vector<cv::Rect>& rectangles, int& frame_id);
+
+    //true from the submit to the poll of a frame
+    bool busy();
+
+private:
+
+    void run();
+
+    MTCNN mtcnn_;
+    cv::Size frame_size_;
+    std::thread thread_;
+
+    //the state shared with the worker, guarded by the mutex
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stop_ = false;
+    bool busy_ = false;
+    bool pending_ = false;
+    bool ready_ = false;
+    cv::Mat frame_;
+    int frame_id_ = 0;
+    std::vector<cv::Rect> regions_;
+    std::vector<cv::Rect> rectangles_;
+};
+
+
+#endif //MTCNN_ASYNCDETECTOR_H
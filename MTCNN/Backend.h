@@ -0,0 +1,16 @@
+//
+// The engine which runs the nets, Caffe or the in-tree LiteNet by the USE_LITENET option of cmake
+//
+
+#ifndef MTCNN_BACKEND_H
+#define MTCNN_BACKEND_H
+
+#ifdef USE_LITENET
+#include "LiteNet.h"
+using namespace litenet;
+#else
+#include <caffe/caffe.hpp>
+using namespace caffe;
+#endif
+
+#endif //MTCNN_BACKEND_H
@@ -0,0 +1,38 @@
+//
+// The octaves of a frame, which are shared by the consumers of the same frame
+//
+
+#include "FramePyramid.h"
+
+void FramePyramid::build(const cv::Mat& frame, int min_size)
+{
+    levels_.assign(1, frame);
+
+    while(std::min(levels_.back().rows, levels_.back().cols) / 2 >= min_size)
+    {
+        const cv::Mat& last = levels_.back();
+
+        //an odd side is made even by repeating its last pixel, so a level is exactly half of the last one
+        cv::Mat even = last;
+        if((last.rows & 1) || (last.cols & 1))
+            cv::copyMakeBorder(last, even, 0, last.rows & 1, 0, last.cols & 1, cv::BORDER_REPLICATE);
+
+        cv::Mat next;
+        cv::resize(even, next, cv::Size(even.cols / 2, even.rows / 2), 0, 0, cv::INTER_AREA);
+        levels_.push_back(next);
+    }
+}
+
+int FramePyramid::level_for(double shrink) const
+{
+    int level = 0;
+    while(level + 1 < levels_.size() && shrink >= (2 << level))
+        level++;
+    return level;
+}
+
+bool FramePyramid::is_of(const cv::Mat& frame) const
+{
+    return !levels_.empty() && levels_[0].data == frame.data && levels_[0].size() == frame.size()
+           && levels_[0].type() == frame.type();
+}
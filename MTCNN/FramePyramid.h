@@ -0,0 +1,42 @@
+//
+// The octaves of a frame, which are shared by the consumers of the same frame
+//
+
+#ifndef MTCNN_FRAMEPYRAMID_H
+#define MTCNN_FRAMEPYRAMID_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+/*
+ * FramePyramid keeps the octaves of a frame, every level is the mean of the 2 * 2 pixels of the level before it.
+ * A resize of the frame which shrinks it by 2^k or more reads the k-th level instead of the frame, so every scale
+ * costs about its own size and the whole frame is read once for all the scales. The pixel (x, y) of the k-th
+ * level covers the pixels from (x, y) * 2^k of the frame, the last odd row and column are repeated.
+ */
+class FramePyramid {
+
+public:
+
+    FramePyramid() {}
+    FramePyramid(const cv::Mat& frame, int min_size = 12) { build(frame, min_size); }
+
+    //build the octaves of the frame until the short side of a level is less than min_size, the frame is not copied
+    void build(const cv::Mat& frame, int min_size = 12);
+
+    //the deepest level which is not smaller than the frame shrunk by shrink
+    int level_for(double shrink) const;
+
+    int levels() const { return levels_.size(); }
+    const cv::Mat& level(int k) const { return levels_[k]; }
+
+    //true if the pyramid is built on the frame
+    bool is_of(const cv::Mat& frame) const;
+
+private:
+
+    std::vector<cv::Mat> levels_;
+};
+
+
+#endif //MTCNN_FRAMEPYRAMID_H
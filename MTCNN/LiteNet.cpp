@@ -0,0 +1,1496 @@
+//
+// A small inference engine for the layers of the MTCNN nets, which could be built instead of Caffe
+//
+
+#include "LiteNet.h"
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace litenet {
+
+namespace {
+
+/*
+ * the tree of a prototxt, every message keeps its fields in the order of the file
+ */
+struct TextNode {
+    std::vector<std::pair<std::string, std::string>> values;
+    std::vector<std::pair<std::string, TextNode>> children;
+
+    std::string get(const std::string& key, const std::string& value = "") const
+    {
+        for(const auto& field : values)
+            if(field.first == key)
+                return field.second;
+        return value;
+    }
+
+    int get_int(const std::string& key, int value) const
+    {
+        std::string text = get(key);
+        return text.empty() ? value : std::atoi(text.c_str());
+    }
+
+    std::vector<std::string> all(const std::string& key) const
+    {
+        std::vector<std::string> found;
+        for(const auto& field : values)
+            if(field.first == key)
+                found.push_back(field.second);
+        return found;
+    }
+
+    const TextNode* child(const std::string& key) const
+    {
+        for(const auto& field : children)
+            if(field.first == key)
+                return &field.second;
+        return nullptr;
+    }
+};
+
+class TextReader {
+public:
+    TextReader(const std::string& text) : text_(text) {}
+
+    //the next token, which is a punctuation, a quoted string without the quotes or a word
+    bool next(std::string& token)
+    {
+        while(pos_ < text_.size())
+        {
+            char c = text_[pos_];
+            if(c == '#')
+                while(pos_ < text_.size() && text_[pos_] != '\n')
+                    pos_++;
+            else if(std::isspace((unsigned char)c))
+                pos_++;
+            else
+                break;
+        }
+        if(pos_ >= text_.size())
+            return false;
+
+        char c = text_[pos_];
+        if(c == '{' || c == '}' || c == ':')
+        {
+            token.assign(1, c);
+            pos_++;
+        }
+        else if(c == '"' || c == '\'')
+        {
+            size_t end = text_.find(c, pos_ + 1);
+            if(end == std::string::npos)
+                end = text_.size();
+            token = text_.substr(pos_ + 1, end - pos_ - 1);
+            pos_ = end + 1;
+        }
+        else
+        {
+            size_t start = pos_;
+            while(pos_ < text_.size() && !std::isspace((unsigned char)text_[pos_]) &&
+                  text_[pos_] != '{' && text_[pos_] != '}' && text_[pos_] != ':' && text_[pos_] != '#')
+                pos_++;
+            token = text_.substr(start, pos_ - start);
+        }
+        return true;
+    }
+
+    //read the fields of a message until its closing brace or the end of the text
+    bool parse(TextNode& node)
+    {
+        std::string key, token;
+        while(next(key))
+        {
+            if(key == "}")
+                return true;
+            if(!next(token))
+                return false;
+            if(token == ":")
+            {
+                if(!next(token))
+                    return false;
+                if(token != "{")
+                {
+                    node.values.emplace_back(key, token);
+                    continue;
+                }
+            }
+            if(token != "{")
+                return false;
+            node.children.emplace_back(key, TextNode());
+            if(!parse(node.children.back().second))
+                return false;
+        }
+        return true;
+    }
+
+private:
+    const std::string& text_;
+    size_t pos_ = 0;
+};
+
+/*
+ * the wire format of protobuf, enough to read the blobs of a caffemodel
+ */
+class WireReader {
+public:
+    WireReader(const unsigned char* begin, const unsigned char* end) : pos_(begin), end_(end) {}
+
+    bool next(int& field, int& wire)
+    {
+        if(pos_ >= end_)
+            return false;
+        uint64_t key = varint();
+        field = (int)(key >> 3);
+        wire = (int)(key & 7);
+        return ok_;
+    }
+
+    uint64_t varint()
+    {
+        uint64_t value = 0;
+        for(int shift = 0; shift < 64; shift += 7)
+        {
+            if(pos_ >= end_)
+            {
+                ok_ = false;
+                return 0;
+            }
+            unsigned char byte = *pos_++;
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if(!(byte & 0x80))
+                return value;
+        }
+        ok_ = false;
+        return value;
+    }
+
+    //the content of a length-delimited field
+    WireReader message()
+    {
+        uint64_t length = varint();
+        if(!ok_ || length > (uint64_t)(end_ - pos_))
+        {
+            ok_ = false;
+            return WireReader(end_, end_);
+        }
+        WireReader sub(pos_, pos_ + length);
+        pos_ += length;
+        return sub;
+    }
+
+    std::string string()
+    {
+        WireReader sub = message();
+        return std::string((const char*)sub.pos_, (const char*)sub.end_);
+    }
+
+    float fixed32()
+    {
+        float value = 0;
+        if(end_ - pos_ < 4)
+        {
+            ok_ = false;
+            return value;
+        }
+        std::memcpy(&value, pos_, 4);
+        pos_ += 4;
+        return value;
+    }
+
+    void skip(int wire)
+    {
+        if(wire == 0)
+            varint();
+        else if(wire == 1)
+            pos_ = std::min(pos_ + 8, end_);
+        else if(wire == 2)
+            message();
+        else if(wire == 5)
+            pos_ = std::min(pos_ + 4, end_);
+        else
+            ok_ = false;
+    }
+
+    bool ok() const { return ok_; }
+    bool done() const { return pos_ >= end_; }
+
+private:
+    const unsigned char* pos_;
+    const unsigned char* end_;
+    bool ok_ = true;
+};
+
+template <typename Dtype>
+std::shared_ptr<Blob<Dtype>> read_blob(WireReader blob)
+{
+    std::vector<int> shape, legacy(4, 0);
+    std::vector<Dtype> data;
+    bool has_legacy = false;
+
+    int field, wire;
+    while(blob.next(field, wire))
+    {
+        if(field == 7 && wire == 2)
+        {
+            //BlobShape, the dims are packed or not
+            WireReader dims = blob.message();
+            int f, w;
+            while(dims.next(f, w))
+            {
+                if(f == 1 && w == 2)
+                {
+                    WireReader packed = dims.message();
+                    while(!packed.done() && packed.ok())
+                        shape.push_back((int)packed.varint());
+                }
+                else if(f == 1 && w == 0)
+                    shape.push_back((int)dims.varint());
+                else
+                    dims.skip(w);
+            }
+        }
+        else if(field == 5 && wire == 2)
+        {
+            WireReader packed = blob.message();
+            while(!packed.done() && packed.ok())
+                data.push_back(packed.fixed32());
+        }
+        else if(field == 5 && wire == 5)
+            data.push_back(blob.fixed32());
+        else if(field >= 1 && field <= 4 && wire == 0)
+        {
+            legacy[field - 1] = (int)blob.varint();
+            has_legacy = true;
+        }
+        else
+            blob.skip(wire);
+    }
+
+    if(shape.empty() && has_legacy)
+        shape = legacy;
+
+    auto result = std::make_shared<Blob<Dtype>>();
+    result->Reshape(shape);
+    if(result->count() != data.size())
+    {
+        std::cout << "Error: The blob has " << data.size() << " values for " << result->count() << "!" << std::endl;
+        result->Reshape(std::vector<int>{(int)data.size()});
+    }
+    std::copy(data.begin(), data.end(), result->mutable_cpu_data());
+    return result;
+}
+
+/*
+ * the packed model file of SavePacked(), in the byte order of the machine:
+ *
+ * "LITENET" 0, uint32 version, uint32 flags, uint32 nets, then every net is
+ *     string prototxt, uint32 records, every record is string layer name, uint32 kind and
+ *     kind 0, the blobs : uint32 blobs, every blob is uint32 axes, uint32 dims[axes], array float data
+ *     kind 1, packed    : uint32 inputs, uint32 outputs, float input range, array float weight[in][out],
+ *                         uint32 n, array float bias[n], uint32 n, array float slope[n], uint32 quantized and
+ *                         if it is, float input scale, array float output scale[out], array int16 weight[out][in]
+ *
+ * a string is uint32 length and the chars, an array starts at a multiple of 64 bytes
+ */
+const char kPackedMagic[8] = {'L', 'I', 'T', 'E', 'N', 'E', 'T', 0};
+const uint32_t kPackedVersion = 1;
+const size_t kPackedAlign = 64;
+
+class PackedWriter {
+public:
+    PackedWriter(std::ofstream& out) : out_(out) {}
+
+    void bytes(const void* data, size_t size)
+    {
+        out_.write((const char*)data, size);
+        pos_ += size;
+    }
+
+    void u32(uint32_t value) { bytes(&value, sizeof(value)); }
+    void f32(float value) { bytes(&value, sizeof(value)); }
+
+    void string(const std::string& value)
+    {
+        u32(value.size());
+        bytes(value.data(), value.size());
+    }
+
+    template <typename T>
+    void array(const T* data, size_t count)
+    {
+        static const char zeros[kPackedAlign] = {};
+        bytes(zeros, (kPackedAlign - pos_ % kPackedAlign) % kPackedAlign);
+        bytes(data, count * sizeof(T));
+    }
+
+private:
+    std::ofstream& out_;
+    size_t pos_ = 0;
+};
+
+class PackedReader {
+public:
+    PackedReader(const unsigned char* begin, const unsigned char* end) : begin_(begin), pos_(begin), end_(end) {}
+
+    const unsigned char* bytes(size_t size)
+    {
+        if(!ok_ || size > (size_t)(end_ - pos_))
+        {
+            ok_ = false;
+            return nullptr;
+        }
+        const unsigned char* data = pos_;
+        pos_ += size;
+        return data;
+    }
+
+    uint32_t u32()
+    {
+        uint32_t value = 0;
+        if(const unsigned char* data = bytes(sizeof(value)))
+            std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    float f32()
+    {
+        float value = 0;
+        if(const unsigned char* data = bytes(sizeof(value)))
+            std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    std::string string()
+    {
+        uint32_t size = u32();
+        const unsigned char* data = bytes(size);
+        return data ? std::string((const char*)data, size) : std::string();
+    }
+
+    //the array where it is in the file
+    template <typename T>
+    const T* array(size_t count)
+    {
+        bytes((kPackedAlign - (pos_ - begin_) % kPackedAlign) % kPackedAlign);
+        if(count > (size_t)(end_ - pos_) / sizeof(T))
+            ok_ = false;
+        return (const T*)bytes(count * sizeof(T));
+    }
+
+    bool ok() const { return ok_; }
+
+private:
+    const unsigned char* begin_;
+    const unsigned char* pos_;
+    const unsigned char* end_;
+    bool ok_ = true;
+};
+
+//a file mapped read-only, which is unmapped with its last user
+struct Mapping {
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+
+    ~Mapping()
+    {
+        if(data)
+            munmap((void*)data, size);
+    }
+};
+
+std::shared_ptr<Mapping> map_file(const std::string& file)
+{
+    int fd = open(file.c_str(), O_RDONLY);
+    if(fd < 0)
+        return nullptr;
+
+    struct stat status;
+    void* data = MAP_FAILED;
+    if(fstat(fd, &status) == 0 && status.st_size > 0)
+        data = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+        return nullptr;
+
+    auto mapping = std::make_shared<Mapping>();
+    mapping->data = (const unsigned char*)data;
+    mapping->size = status.st_size;
+    return mapping;
+}
+
+//the strides of the n, c, y and x axes of a blob in the NCHW or the NHWC order
+struct Strides {
+    int n, c, y, x;
+};
+
+template <typename Dtype>
+Strides strides_of(const Blob<Dtype>& blob, bool planar)
+{
+    int c = blob.channels(), h = blob.height(), w = blob.width();
+    if(planar)
+        return {c * h * w, h * w, w, 1};
+    return {c * h * w, 1, w * c, c};
+}
+
+//the float kernels of the convolution and the inner product are built for these instruction sets, as the int8
+//ones, and the one of the cpu is chosen when the program starts. The nets are float only
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__)
+#define LITENET_FLOAT_TARGETS __attribute__((target_clones("arch=skylake-avx512", "arch=haswell", "default")))
+#else
+#define LITENET_FLOAT_TARGETS
+#endif
+
+/*
+ * the kernels of the layers, the blobs are 4D, a 2D blob is a blob of 1 * 1 maps
+ */
+LITENET_FLOAT_TARGETS
+void convolution(const Blob<float>& bottom, Strides is, Blob<float>& top, Strides os, int kernel, int stride, int pad,
+                 const float* weight, const float* bias, const float* slope)
+{
+    const int num = bottom.num(), channels = bottom.channels(), height = bottom.height(), width = bottom.width();
+    const int outputs = top.channels(), out_height = top.height(), out_width = top.width();
+    const float* in = bottom.cpu_data();
+    float* out = top.mutable_cpu_data();
+
+    std::vector<float> acc(outputs);
+    for(int n = 0; n < num; n++)
+    {
+        for(int oy = 0; oy < out_height; oy++)
+        {
+            for(int ox = 0; ox < out_width; ox++)
+            {
+                float* a = acc.data();
+                for(int o = 0; o < outputs; o++)
+                    a[o] = bias ? bias[o] : 0;
+
+                for(int ky = 0; ky < kernel; ky++)
+                {
+                    int iy = oy * stride + ky - pad;
+                    if(iy < 0 || iy >= height)
+                        continue;
+                    for(int kx = 0; kx < kernel; kx++)
+                    {
+                        int ix = ox * stride + kx - pad;
+                        if(ix < 0 || ix >= width)
+                            continue;
+
+                        const float* x = in + n * is.n + iy * is.y + ix * is.x;
+                        const float* w = weight + (ky * kernel + kx) * channels * outputs;
+                        for(int c = 0; c < channels; c++, w += outputs)
+                        {
+                            const float v = x[c * is.c];
+                            for(int o = 0; o < outputs; o++)
+                                a[o] += v * w[o];
+                        }
+                    }
+                }
+
+                if(slope)
+                    for(int o = 0; o < outputs; o++)
+                        a[o] = a[o] > 0 ? a[o] : a[o] * slope[o];
+
+                float* y = out + n * os.n + oy * os.y + ox * os.x;
+                for(int o = 0; o < outputs; o++)
+                    y[o * os.c] = a[o];
+            }
+        }
+    }
+}
+
+template <typename Dtype>
+void max_pooling(const Blob<Dtype>& bottom, Strides is, Blob<Dtype>& top, Strides os, int kernel, int stride, int pad)
+{
+    const int num = bottom.num(), channels = bottom.channels(), height = bottom.height(), width = bottom.width();
+    const int out_height = top.height(), out_width = top.width();
+    const Dtype* in = bottom.cpu_data();
+    Dtype* out = top.mutable_cpu_data();
+
+    std::vector<Dtype> acc(channels);
+    for(int n = 0; n < num; n++)
+    {
+        for(int oy = 0; oy < out_height; oy++)
+        {
+            int y0 = std::max(oy * stride - pad, 0), y1 = std::min(oy * stride - pad + kernel, height);
+            for(int ox = 0; ox < out_width; ox++)
+            {
+                int x0 = std::max(ox * stride - pad, 0), x1 = std::min(ox * stride - pad + kernel, width);
+                Dtype* a = acc.data();
+                std::fill(acc.begin(), acc.end(), -FLT_MAX);
+                for(int iy = y0; iy < y1; iy++)
+                {
+                    for(int ix = x0; ix < x1; ix++)
+                    {
+                        const Dtype* x = in + n * is.n + iy * is.y + ix * is.x;
+                        for(int c = 0; c < channels; c++)
+                            a[c] = std::max(a[c], x[c * is.c]);
+                    }
+                }
+
+                Dtype* y = out + n * os.n + oy * os.y + ox * os.x;
+                for(int c = 0; c < channels; c++)
+                    y[c * os.c] = a[c];
+            }
+        }
+    }
+}
+
+//the bottom is read in its memory order, the weight is packed for the same order
+LITENET_FLOAT_TARGETS
+void inner_product(const Blob<float>& bottom, Blob<float>& top, Strides os, const float* weight, const float* bias,
+                   const float* slope)
+{
+    const int num = bottom.num(), inputs = bottom.count() / std::max(num, 1), outputs = top.channels();
+    const float* in = bottom.cpu_data();
+    float* out = top.mutable_cpu_data();
+
+    std::vector<float> acc(outputs);
+    for(int n = 0; n < num; n++)
+    {
+        float* a = acc.data();
+        for(int o = 0; o < outputs; o++)
+            a[o] = bias ? bias[o] : 0;
+
+        const float* x = in + n * inputs;
+        const float* w = weight;
+        for(int i = 0; i < inputs; i++, w += outputs)
+        {
+            const float v = x[i];
+            for(int o = 0; o < outputs; o++)
+                a[o] += v * w[o];
+        }
+
+        if(slope)
+            for(int o = 0; o < outputs; o++)
+                a[o] = a[o] > 0 ? a[o] : a[o] * slope[o];
+
+        for(int o = 0; o < outputs; o++)
+            out[n * os.n + o * os.c] = a[o];
+    }
+}
+
+template <typename Dtype>
+void prelu(const Blob<Dtype>& bottom, Strides is, Blob<Dtype>& top, Strides os, const Dtype* slope)
+{
+    const int num = bottom.num(), channels = bottom.channels(), height = bottom.height(), width = bottom.width();
+    const Dtype* in = bottom.cpu_data();
+    Dtype* out = top.mutable_cpu_data();
+
+    for(int n = 0; n < num; n++)
+        for(int y = 0; y < height; y++)
+            for(int x = 0; x < width; x++)
+                for(int c = 0; c < channels; c++)
+                {
+                    Dtype v = in[n * is.n + c * is.c + y * is.y + x * is.x];
+                    out[n * os.n + c * os.c + y * os.y + x * os.x] = v > 0 ? v : v * slope[c];
+                }
+}
+
+template <typename Dtype>
+void softmax(const Blob<Dtype>& bottom, Strides is, Blob<Dtype>& top, Strides os)
+{
+    const int num = bottom.num(), channels = bottom.channels(), height = bottom.height(), width = bottom.width();
+    const Dtype* in = bottom.cpu_data();
+    Dtype* out = top.mutable_cpu_data();
+
+    std::vector<Dtype> e(channels);
+    for(int n = 0; n < num; n++)
+        for(int y = 0; y < height; y++)
+            for(int x = 0; x < width; x++)
+            {
+                const Dtype* v = in + n * is.n + y * is.y + x * is.x;
+                Dtype max = v[0];
+                for(int c = 1; c < channels; c++)
+                    max = std::max(max, v[c * is.c]);
+
+                Dtype sum = 0;
+                for(int c = 0; c < channels; c++)
+                {
+                    e[c] = std::exp(v[c * is.c] - max);
+                    sum += e[c];
+                }
+
+                Dtype* p = out + n * os.n + y * os.y + x * os.x;
+                for(int c = 0; c < channels; c++)
+                    p[c * os.c] = e[c] / sum;
+            }
+}
+
+//the int8 kernels are built for these instruction sets and the one of the cpu is chosen when the program starts
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__)
+#define LITENET_INT8_TARGETS __attribute__((target_clones("arch=icelake-server", "avx2", "default")))
+#else
+#define LITENET_INT8_TARGETS
+#endif
+
+//acc[o] is the dot product of the patch and the o-th row of the weights. The int8 values are kept in int16, the
+//sum of their products in int32 is vectorized as pmaddwd, vpmaddwd with AVX2 and vpdpwssd with VNNI
+LITENET_INT8_TARGETS
+void gemv_int8(const int16_t* x, const int16_t* weight, int length, int outputs, int32_t* acc)
+{
+    for(int o = 0; o < outputs; o++, weight += length)
+    {
+        int32_t sum = 0;
+        for(int i = 0; i < length; i++)
+            sum += x[i] * weight[i];
+        acc[o] = sum;
+    }
+}
+
+template <typename Dtype>
+void quantize_input(const Blob<Dtype>& bottom, Dtype scale, std::vector<int16_t>& input)
+{
+    const int count = bottom.count();
+    const Dtype* in = bottom.cpu_data();
+    const Dtype inverse = 1 / scale;
+
+    input.resize(count);
+    for(int i = 0; i < count; i++)
+    {
+        Dtype v = std::round(in[i] * inverse);
+        input[i] = (int16_t)std::min(std::max(v, (Dtype)-127), (Dtype)127);
+    }
+}
+
+//the result of the int8 kernels in float with the bias and the PReLU
+template <typename Dtype>
+void dequantize(const int32_t* acc, int outputs, const Dtype* scale, const Dtype* bias, const Dtype* slope,
+                Dtype* out, int stride)
+{
+    for(int o = 0; o < outputs; o++)
+    {
+        Dtype v = acc[o] * scale[o] + (bias ? bias[o] : 0);
+        if(slope && v < 0)
+            v *= slope[o];
+        out[o * stride] = v;
+    }
+}
+
+//the patch of every output is gathered in the order [ky][kx][in], the input is quantized in the order of the bottom
+template <typename Dtype>
+void convolution_int8(const int16_t* in, const Blob<Dtype>& bottom, Strides is, Blob<Dtype>& top, Strides os,
+                      int kernel, int stride, int pad, const int16_t* weight, const Dtype* scale, const Dtype* bias,
+                      const Dtype* slope)
+{
+    const int num = bottom.num(), channels = bottom.channels(), height = bottom.height(), width = bottom.width();
+    const int outputs = top.channels(), out_height = top.height(), out_width = top.width();
+    const int length = kernel * kernel * channels;
+    Dtype* out = top.mutable_cpu_data();
+
+    std::vector<int16_t> patch(length);
+    std::vector<int32_t> acc(outputs);
+    for(int n = 0; n < num; n++)
+    {
+        for(int oy = 0; oy < out_height; oy++)
+        {
+            for(int ox = 0; ox < out_width; ox++)
+            {
+                int16_t* p = patch.data();
+                for(int ky = 0; ky < kernel; ky++)
+                {
+                    int iy = oy * stride + ky - pad;
+                    for(int kx = 0; kx < kernel; kx++, p += channels)
+                    {
+                        int ix = ox * stride + kx - pad;
+                        if(iy < 0 || iy >= height || ix < 0 || ix >= width)
+                        {
+                            std::fill(p, p + channels, 0);
+                            continue;
+                        }
+                        const int16_t* x = in + n * is.n + iy * is.y + ix * is.x;
+                        for(int c = 0; c < channels; c++)
+                            p[c] = x[c * is.c];
+                    }
+                }
+
+                gemv_int8(patch.data(), weight, length, outputs, acc.data());
+                dequantize(acc.data(), outputs, scale, bias, slope, out + n * os.n + oy * os.y + ox * os.x, os.c);
+            }
+        }
+    }
+}
+
+template <typename Dtype>
+void inner_product_int8(const int16_t* in, const Blob<Dtype>& bottom, Blob<Dtype>& top, Strides os,
+                        const int16_t* weight, const Dtype* scale, const Dtype* bias, const Dtype* slope)
+{
+    const int num = bottom.num(), inputs = bottom.count() / std::max(num, 1), outputs = top.channels();
+    Dtype* out = top.mutable_cpu_data();
+
+    std::vector<int32_t> acc(outputs);
+    for(int n = 0; n < num; n++)
+    {
+        gemv_int8(in + n * inputs, weight, inputs, outputs, acc.data());
+        dequantize(acc.data(), outputs, scale, bias, slope, out + n * os.n, os.c);
+    }
+}
+
+//copy the channels [from, from + count) of the bottom to the channels [to, to + count) of the top
+template <typename Dtype>
+void copy_channels(const Blob<Dtype>& bottom, Strides is, int from, Blob<Dtype>& top, Strides os, int to, int count)
+{
+    const int num = bottom.num(), height = bottom.height(), width = bottom.width();
+    const Dtype* in = bottom.cpu_data();
+    Dtype* out = top.mutable_cpu_data();
+
+    for(int n = 0; n < num; n++)
+        for(int y = 0; y < height; y++)
+            for(int x = 0; x < width; x++)
+                for(int c = 0; c < count; c++)
+                    out[n * os.n + (to + c) * os.c + y * os.y + x * os.x] =
+                            in[n * is.n + (from + c) * is.c + y * is.y + x * is.x];
+}
+
+}
+
+template <typename Dtype>
+Net<Dtype>::Net(const std::string& param_file, Phase phase, const int level, const std::vector<std::string>* stages)
+{
+    //a net which can not be read is never used, as the failed CHECK of Caffe
+    std::ifstream file(param_file);
+    if(!file)
+        throw std::runtime_error("Can not open " + param_file);
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if(!Init(text, phase))
+        throw std::runtime_error("Can not parse " + param_file);
+}
+
+template <typename Dtype>
+bool Net<Dtype>::Init(const std::string& prototxt, Phase phase)
+{
+    prototxt_ = prototxt;
+    phase_ = phase;
+
+    TextNode root;
+    if(!TextReader(prototxt_).parse(root))
+        return false;
+    name_ = root.get("name");
+
+    std::map<std::string, int> blob_ids;
+    auto blob_id = [&](const std::string& name) {
+        auto found = blob_ids.find(name);
+        if(found != blob_ids.end())
+            return found->second;
+        blob_ids[name] = blobs_.size();
+        blobs_.push_back(std::make_shared<Blob<Dtype>>());
+        blob_names_.push_back(name);
+        planar_.push_back(false);
+        return (int)blobs_.size() - 1;
+    };
+
+    //the inputs are given by input and input_dim, or input and input_shape
+    std::vector<std::string> inputs = root.all("input");
+    std::vector<std::string> input_dims = root.all("input_dim");
+    std::vector<const TextNode*> input_shapes;
+    for(const auto& field : root.children)
+        if(field.first == "input_shape")
+            input_shapes.push_back(&field.second);
+
+    for(int i = 0; i < inputs.size(); i++)
+    {
+        std::vector<int> shape;
+        if(i < input_shapes.size())
+            for(const auto& dim : input_shapes[i]->all("dim"))
+                shape.push_back(std::atoi(dim.c_str()));
+        else
+            for(int d = i * 4; d < i * 4 + 4 && d < input_dims.size(); d++)
+                shape.push_back(std::atoi(input_dims[d].c_str()));
+
+        int id = blob_id(inputs[i]);
+        blobs_[id]->Reshape(shape);
+        planar_[id] = true;
+        input_blobs_.push_back(blobs_[id].get());
+    }
+
+    std::set<std::string> available(inputs.begin(), inputs.end());
+    for(const auto& field : root.children)
+    {
+        if(field.first != "layer")
+            continue;
+        const TextNode& param = field.second;
+
+        //the layers of the train phase are not built
+        const TextNode* include = param.child("include");
+        if(include && include->get("phase", "TEST") != (phase == TEST ? "TEST" : "TRAIN"))
+            continue;
+
+        auto layer = std::make_shared<Layer<Dtype>>();
+        layer->param_.name_ = param.get("name");
+        layer->param_.type_ = param.get("type");
+
+        const TextNode* conv = param.child("convolution_param");
+        const TextNode* pool = param.child("pooling_param");
+        const TextNode* inner = param.child("inner_product_param");
+        const TextNode* slice = param.child("slice_param");
+        const TextNode* concat = param.child("concat_param");
+        const TextNode* softmax = param.child("softmax_param");
+        if(conv)
+        {
+            layer->num_output_ = conv->get_int("num_output", 0);
+            layer->kernel_ = conv->get_int("kernel_size", 1);
+            layer->stride_ = conv->get_int("stride", 1);
+            layer->pad_ = conv->get_int("pad", 0);
+        }
+        if(pool)
+        {
+            layer->kernel_ = pool->get_int("kernel_size", 1);
+            layer->stride_ = pool->get_int("stride", 1);
+            layer->pad_ = pool->get_int("pad", 0);
+            layer->max_pool_ = pool->get("pool", "MAX") == "MAX";
+        }
+        if(inner)
+            layer->num_output_ = inner->get_int("num_output", 0);
+        if(slice)
+        {
+            layer->axis_ = slice->get_int("axis", 1);
+            for(const auto& point : slice->all("slice_point"))
+                layer->slice_points_.push_back(std::atoi(point.c_str()));
+        }
+        if(concat)
+            layer->axis_ = concat->get_int("axis", 1);
+        if(softmax)
+            layer->axis_ = softmax->get_int("axis", 1);
+
+        const std::string& type = layer->param_.type_;
+        if(type != "Convolution" && type != "PReLU" && type != "Pooling" && type != "InnerProduct" &&
+           type != "Softmax" && type != "Concat" && type != "Slice" && type != "Dropout")
+            std::cout << "Error: The layer " << layer->param_.name_ << " of type " << type << " is not supported!" << std::endl;
+        if(type == "Pooling" && !layer->max_pool_)
+            std::cout << "Error: Only the max pooling is supported, " << layer->param_.name_ << "!" << std::endl;
+        if(layer->axis_ != 1)
+            std::cout << "Error: Only the channel axis is supported, " << layer->param_.name_ << "!" << std::endl;
+
+        std::vector<Blob<Dtype>*> bottom_vec, top_vec;
+        for(const auto& bottom : param.all("bottom"))
+        {
+            int id = blob_id(bottom);
+            layer->bottoms_.push_back(id);
+            bottom_vec.push_back(blobs_[id].get());
+            available.erase(bottom);
+        }
+        for(const auto& top : param.all("top"))
+        {
+            int id = blob_id(top);
+            layer->tops_.push_back(id);
+            top_vec.push_back(blobs_[id].get());
+            available.insert(top);
+        }
+
+        //a PReLU in place is done by the convolution or the inner product which writes its blob, a Dropout in
+        //place between them is the identity at test
+        if(type == "PReLU" && layer->bottoms_.size() == 1 && layer->tops_ == layer->bottoms_)
+        {
+            for(int l = (int)layers_.size() - 1; l >= 0; l--)
+            {
+                Layer<Dtype>& before = *layers_[l];
+                if(before.tops_.size() != 1 || before.tops_[0] != layer->bottoms_[0])
+                    continue;
+                if(before.type() == std::string("Dropout") && before.bottoms_ == before.tops_)
+                    continue;
+                if((before.type() == std::string("Convolution") || before.type() == std::string("InnerProduct")) &&
+                   before.prelu_ < 0)
+                {
+                    before.prelu_ = layers_.size();
+                    layer->fused_ = true;
+                }
+                break;
+            }
+        }
+
+        layers_.push_back(layer);
+        layer_names_.push_back(layer->param_.name_);
+        bottom_vecs_.push_back(bottom_vec);
+        top_vecs_.push_back(top_vec);
+    }
+
+    //the blobs which are not used by any layer are the outputs, in the order of their names as Caffe
+    for(const auto& name : available)
+    {
+        int id = blob_ids[name];
+        planar_[id] = true;
+        output_blobs_.push_back(blobs_[id].get());
+    }
+
+    Reshape();
+    return true;
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFrom(const std::string& trained_file)
+{
+    std::ifstream file(trained_file, std::ios::binary);
+    if(!file)
+        throw std::runtime_error("Can not open " + trained_file);
+    std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    //NetParameter, the layers are in the field 100, or 2 of the V1 layers
+    WireReader net(bytes.data(), bytes.data() + bytes.size());
+    int field, wire;
+    while(net.next(field, wire))
+    {
+        if(!((field == 100 || field == 2) && wire == 2))
+        {
+            net.skip(wire);
+            continue;
+        }
+
+        const int name_field = field == 100 ? 1 : 4, blob_field = field == 100 ? 7 : 6;
+        WireReader param = net.message();
+        std::string name;
+        std::vector<std::shared_ptr<Blob<Dtype>>> blobs;
+        int f, w;
+        while(param.next(f, w))
+        {
+            if(f == name_field && w == 2)
+                name = param.string();
+            else if(f == blob_field && w == 2)
+                blobs.push_back(read_blob<Dtype>(param.message()));
+            else
+                param.skip(w);
+        }
+
+        auto found = std::find(layer_names_.begin(), layer_names_.end(), name);
+        if(found == layer_names_.end() || blobs.empty())
+            continue;
+        Layer<Dtype>& layer = *layers_[found - layer_names_.begin()];
+        layer.blobs_ = blobs;
+        layer.packed_ = std::make_shared<typename Layer<Dtype>::Packed>();
+    }
+
+    if(!net.ok())
+        throw std::runtime_error(trained_file + " is broken");
+}
+
+template <typename Dtype>
+void Net<Dtype>::ShareTrainedLayersWith(const Net* other)
+{
+    for(int l = 0; l < layers_.size(); l++)
+    {
+        auto found = std::find(other->layer_names_.begin(), other->layer_names_.end(), layer_names_[l]);
+        if(found == other->layer_names_.end())
+            continue;
+        const Layer<Dtype>& source = *other->layers_[found - other->layer_names_.begin()];
+        layers_[l]->blobs_ = source.blobs_;
+        layers_[l]->packed_ = source.packed_;
+    }
+}
+
+template <typename Dtype>
+void Net<Dtype>::Reshape()
+{
+    for(int l = 0; l < layers_.size(); l++)
+    {
+        Layer<Dtype>& layer = *layers_[l];
+        const std::string type = layer.type();
+        if(layer.bottoms_.empty())
+            continue;
+        const Blob<Dtype>& bottom = *blobs_[layer.bottoms_[0]];
+        const int num = bottom.num(), height = bottom.height(), width = bottom.width();
+
+        if(type == "Convolution")
+        {
+            int out_height = (height + 2 * layer.pad_ - layer.kernel_) / layer.stride_ + 1;
+            int out_width = (width + 2 * layer.pad_ - layer.kernel_) / layer.stride_ + 1;
+            blobs_[layer.tops_[0]]->Reshape(num, layer.num_output_, out_height, out_width);
+        }
+        else if(type == "Pooling")
+        {
+            //the ceil mode of Caffe, the last window does not start in the padding
+            int out_height = (height + 2 * layer.pad_ - layer.kernel_ + layer.stride_ - 1) / layer.stride_ + 1;
+            int out_width = (width + 2 * layer.pad_ - layer.kernel_ + layer.stride_ - 1) / layer.stride_ + 1;
+            if(layer.pad_ > 0)
+            {
+                if((out_height - 1) * layer.stride_ >= height + layer.pad_)
+                    out_height--;
+                if((out_width - 1) * layer.stride_ >= width + layer.pad_)
+                    out_width--;
+            }
+            blobs_[layer.tops_[0]]->Reshape(num, bottom.channels(), out_height, out_width);
+        }
+        else if(type == "InnerProduct")
+            blobs_[layer.tops_[0]]->Reshape(std::vector<int>{num, layer.num_output_});
+        else if(type == "Concat")
+        {
+            std::vector<int> shape = bottom.shape();
+            shape[1] = 0;
+            for(int id : layer.bottoms_)
+                shape[1] += blobs_[id]->channels();
+            blobs_[layer.tops_[0]]->Reshape(shape);
+        }
+        else if(type == "Slice")
+        {
+            std::vector<int> points = layer.slice_points_;
+            if(points.empty())
+                for(int t = 1; t < layer.tops_.size(); t++)
+                    points.push_back(bottom.channels() / layer.tops_.size() * t);
+            points.insert(points.begin(), 0);
+            points.push_back(bottom.channels());
+            for(int t = 0; t < layer.tops_.size(); t++)
+            {
+                std::vector<int> shape = bottom.shape();
+                shape[1] = points[t + 1] - points[t];
+                blobs_[layer.tops_[t]]->Reshape(shape);
+            }
+        }
+        else if(layer.tops_[0] != layer.bottoms_[0])
+            blobs_[layer.tops_[0]]->Reshape(bottom.shape());
+    }
+}
+
+/*
+ * patch_order() function
+ * used to find the place of every input of a convolution or an inner product in the patch the kernel reads. The
+ * input i of Caffe is c * area + p, which is p * channels + c in a patch [ky][kx][in] or an NHWC bottom
+ */
+template <typename Dtype>
+std::vector<int> Net<Dtype>::patch_order(const Layer<Dtype>& layer) const
+{
+    const Blob<Dtype>& weight = *layer.blobs_[0];
+    const int outputs = weight.shape(0), inputs = weight.count() / std::max(outputs, 1);
+
+    bool planar = false;
+    int channels = weight.shape(1);
+    if(std::string(layer.type()) == "InnerProduct")
+    {
+        const int bottom = layer.bottoms_[0];
+        planar = planar_[bottom] || blobs_[bottom]->num_axes() < 4;
+        channels = blobs_[bottom]->channels();
+    }
+
+    const int area = inputs / std::max(channels, 1);
+    std::vector<int> order(inputs);
+    for(int i = 0; i < inputs; i++)
+        order[i] = planar ? i : (i % area) * channels + i / area;
+    return order;
+}
+
+/*
+ * pack() function
+ * used to reorder the weights of a layer for its kernel, [ky][kx][in][out] for a convolution and [in][out] for
+ * an inner product, so the innermost loops run over the outputs
+ */
+template <typename Dtype>
+void Net<Dtype>::pack(Layer<Dtype>& layer)
+{
+    auto& packed = *layer.packed_;
+    //the layer is packed again at the next forward if this throws, so the net never runs without weights
+    if(layer.blobs_.empty())
+        throw std::runtime_error("The layer " + layer.param_.name_ + " has no weights");
+    if(layer.prelu_ >= 0 && layers_[layer.prelu_]->blobs_.empty())
+        throw std::runtime_error("The layer " + layers_[layer.prelu_]->param_.name_ + " has no weights");
+
+    const Blob<Dtype>& weight = *layer.blobs_[0];
+    const Dtype* w = weight.cpu_data();
+    const int outputs = weight.shape(0), inputs = weight.count() / std::max(outputs, 1);
+    const std::vector<int> order = patch_order(layer);
+
+    packed.inputs = inputs;
+    packed.outputs = outputs;
+    packed.weight_storage.resize(weight.count());
+    for(int o = 0; o < outputs; o++)
+        for(int i = 0; i < inputs; i++)
+            packed.weight_storage[order[i] * outputs + o] = w[o * inputs + i];
+    packed.weight = packed.weight_storage.data();
+
+    if(layer.blobs_.size() > 1)
+        packed.bias.assign(layer.blobs_[1]->cpu_data(), layer.blobs_[1]->cpu_data() + outputs);
+
+    if(layer.prelu_ >= 0)
+    {
+        const Blob<Dtype>& slope = *layers_[layer.prelu_]->blobs_[0];
+        packed.slope.resize(outputs);
+        for(int o = 0; o < outputs; o++)
+            packed.slope[o] = slope.cpu_data()[slope.count() == 1 ? 0 : o];
+    }
+}
+
+/*
+ * pack_int8() function
+ * used to quantize the packed weights of a layer with a scale per output, one row [ky][kx][in] per output. The
+ * input is quantized with the range of the calibration, so a product of the kernel is scaled back by the two scales
+ */
+template <typename Dtype>
+void Net<Dtype>::pack_int8(Layer<Dtype>& layer)
+{
+    auto& packed = *layer.packed_;
+    const int outputs = packed.outputs, inputs = packed.inputs;
+
+    packed.input_scale = packed.input_range / 127;
+    packed.output_scale.resize(outputs);
+    packed.weight_q_storage.resize(inputs * outputs);
+    for(int o = 0; o < outputs; o++)
+    {
+        Dtype range = 0;
+        for(int i = 0; i < inputs; i++)
+            range = std::max(range, (Dtype)std::abs(packed.weight[i * outputs + o]));
+        Dtype scale = range > 0 ? range / 127 : 1;
+
+        int16_t* row = packed.weight_q_storage.data() + o * inputs;
+        for(int i = 0; i < inputs; i++)
+            row[i] = (int16_t)std::round(packed.weight[i * outputs + o] / scale);
+        packed.output_scale[o] = packed.input_scale * scale;
+    }
+    packed.weight_q = packed.weight_q_storage.data();
+}
+
+template <typename Dtype>
+void Net<Dtype>::Calibrate(bool on)
+{
+    for(auto& layer : layers_)
+    {
+        const std::string type = layer->type();
+        if(type == "Convolution" || type == "InnerProduct")
+            layer->packed_->calibrating = on;
+    }
+}
+
+template <typename Dtype>
+bool Net<Dtype>::Quantize()
+{
+    bool all = true;
+    for(auto& layer : layers_)
+    {
+        const std::string type = layer->type();
+        if(type != "Convolution" && type != "InnerProduct")
+            continue;
+
+        auto& packed = *layer->packed_;
+        if(packed.input_range <= 0)
+        {
+            std::cout << "Error: The layer " << layer->param_.name_ << " is not calibrated, it is kept in float!" << std::endl;
+            all = false;
+            continue;
+        }
+
+        std::call_once(packed.once, [&] { pack(*layer); });
+        if(!packed.weight)
+        {
+            all = false;
+            continue;
+        }
+        pack_int8(*layer);
+        packed.quantized = true;
+    }
+    return all;
+}
+
+template <typename Dtype>
+bool Net<Dtype>::quantized() const
+{
+    for(const auto& layer : layers_)
+        if(layer->packed_->quantized)
+            return true;
+    return false;
+}
+
+template <typename Dtype>
+const std::vector<Blob<Dtype>*>& Net<Dtype>::Forward(Dtype* loss)
+{
+    for(int l = 0; l < layers_.size(); l++)
+    {
+        Layer<Dtype>& layer = *layers_[l];
+        const std::string type = layer.type();
+        if(layer.fused_ || layer.bottoms_.empty() || layer.tops_.empty())
+            continue;
+
+        const int b = layer.bottoms_[0], t = layer.tops_[0];
+        Blob<Dtype>& bottom = *blobs_[b];
+        Blob<Dtype>& top = *blobs_[t];
+        const Strides is = strides_of(bottom, planar_[b]), os = strides_of(top, planar_[t]);
+
+        if(type == "Convolution" || type == "InnerProduct")
+        {
+            auto& packed = *layer.packed_;
+            if(packed.calibrating)
+            {
+                Dtype range = 0;
+                for(int i = 0; i < bottom.count(); i++)
+                    range = std::max(range, (Dtype)std::abs(bottom.cpu_data()[i]));
+                std::lock_guard<std::mutex> lock(packed.range_mutex);
+                packed.input_range = std::max(packed.input_range, range);
+            }
+
+            std::call_once(packed.once, [&] { pack(layer); });
+            if(!packed.weight)
+                throw std::runtime_error("The layer " + layer.param_.name_ + " has no weights");
+
+            const Dtype* bias = packed.bias.empty() ? nullptr : packed.bias.data();
+            const Dtype* slope = packed.slope.empty() ? nullptr : packed.slope.data();
+            if(packed.quantized)
+            {
+                quantize_input(bottom, packed.input_scale, input_q_);
+                if(type == "Convolution")
+                    convolution_int8(input_q_.data(), bottom, is, top, os, layer.kernel_, layer.stride_, layer.pad_,
+                                     packed.weight_q, packed.output_scale.data(), bias, slope);
+                else
+                    inner_product_int8(input_q_.data(), bottom, top, os, packed.weight_q,
+                                       packed.output_scale.data(), bias, slope);
+            }
+            else if(type == "Convolution")
+                convolution(bottom, is, top, os, layer.kernel_, layer.stride_, layer.pad_, packed.weight, bias, slope);
+            else
+                inner_product(bottom, top, os, packed.weight, bias, slope);
+        }
+        else if(type == "Pooling")
+            max_pooling(bottom, is, top, os, layer.kernel_, layer.stride_, layer.pad_);
+        else if(type == "PReLU")
+        {
+            const Blob<Dtype>& slope = *layer.blobs_[0];
+            std::vector<Dtype> slopes(bottom.channels());
+            for(int c = 0; c < slopes.size(); c++)
+                slopes[c] = slope.cpu_data()[slope.count() == 1 ? 0 : c];
+            prelu(bottom, is, top, os, slopes.data());
+        }
+        else if(type == "Softmax")
+            softmax(bottom, is, top, os);
+        else if(type == "Concat")
+        {
+            int offset = 0;
+            for(int id : layer.bottoms_)
+            {
+                const Blob<Dtype>& part = *blobs_[id];
+                copy_channels(part, strides_of(part, planar_[id]), 0, top, os, offset, part.channels());
+                offset += part.channels();
+            }
+        }
+        else if(type == "Slice")
+        {
+            int offset = 0;
+            for(int id : layer.tops_)
+            {
+                Blob<Dtype>& part = *blobs_[id];
+                copy_channels(bottom, is, offset, part, strides_of(part, planar_[id]), 0, part.channels());
+                offset += part.channels();
+            }
+        }
+        else if(type == "Dropout" && t != b)
+            copy_channels(bottom, is, 0, top, os, 0, bottom.channels());
+    }
+
+    if(loss)
+        *loss = 0;
+    return output_blobs_;
+}
+
+template <typename Dtype>
+std::shared_ptr<Net<Dtype>> Net<Dtype>::Replicate() const
+{
+    std::shared_ptr<Net> net(new Net());
+    net->Init(prototxt_, phase_);
+    net->ShareTrainedLayersWith(this);
+    return net;
+}
+
+//the weights are written and mapped as float
+template <typename Dtype>
+bool Net<Dtype>::SavePacked(const std::string& file, const std::vector<Net*>& nets, uint32_t flags)
+{
+    static_assert(sizeof(Dtype) == sizeof(float), "The packed model is in float");
+
+    std::ofstream out(file, std::ios::binary);
+    if(!out)
+    {
+        std::cout << "Error: Can not open " << file << "!" << std::endl;
+        return false;
+    }
+
+    PackedWriter writer(out);
+    writer.bytes(kPackedMagic, sizeof(kPackedMagic));
+    writer.u32(kPackedVersion);
+    writer.u32(flags);
+    writer.u32(nets.size());
+
+    for(Net* net : nets)
+    {
+        //the convolutions and the inner products are packed, the other layers keep their blobs
+        std::vector<Layer<Dtype>*> records;
+        for(auto& layer : net->layers_)
+        {
+            const std::string type = layer->type();
+            if(type == "Convolution" || type == "InnerProduct")
+            {
+                std::call_once(layer->packed_->once, [&] { net->pack(*layer); });
+                if(layer->packed_->weight)
+                    records.push_back(layer.get());
+            }
+            else if(!layer->fused_ && !layer->blobs_.empty())
+                records.push_back(layer.get());
+        }
+
+        writer.string(net->prototxt_);
+        writer.u32(records.size());
+        for(Layer<Dtype>* layer : records)
+        {
+            writer.string(layer->param_.name_);
+            const auto& packed = *layer->packed_;
+            if(!packed.weight)
+            {
+                writer.u32(0);
+                writer.u32(layer->blobs_.size());
+                for(const auto& blob : layer->blobs_)
+                {
+                    writer.u32(blob->num_axes());
+                    for(int dim : blob->shape())
+                        writer.u32(dim);
+                    writer.array(blob->cpu_data(), blob->count());
+                }
+                continue;
+            }
+
+            writer.u32(1);
+            writer.u32(packed.inputs);
+            writer.u32(packed.outputs);
+            writer.f32(packed.input_range);
+            writer.array(packed.weight, (size_t)packed.inputs * packed.outputs);
+            writer.u32(packed.bias.size());
+            writer.array(packed.bias.data(), packed.bias.size());
+            writer.u32(packed.slope.size());
+            writer.array(packed.slope.data(), packed.slope.size());
+            writer.u32(packed.quantized);
+            if(packed.quantized)
+            {
+                writer.f32(packed.input_scale);
+                writer.array(packed.output_scale.data(), packed.outputs);
+                writer.array(packed.weight_q, (size_t)packed.inputs * packed.outputs);
+            }
+        }
+    }
+
+    out.close();
+    if(!out)
+    {
+        std::cout << "Error: Can not write " << file << "!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+template <typename Dtype>
+std::vector<std::shared_ptr<Net<Dtype>>> Net<Dtype>::LoadPacked(const std::string& file, uint32_t* flags)
+{
+    std::vector<std::shared_ptr<Net>> nets;
+    std::shared_ptr<Mapping> mapping = map_file(file);
+    if(!mapping)
+    {
+        std::cout << "Error: Can not map " << file << "!" << std::endl;
+        return nets;
+    }
+
+    PackedReader reader(mapping->data, mapping->data + mapping->size);
+    const unsigned char* magic = reader.bytes(sizeof(kPackedMagic));
+    if(!magic || std::memcmp(magic, kPackedMagic, sizeof(kPackedMagic)) != 0 || reader.u32() != kPackedVersion)
+    {
+        std::cout << "Error: " << file << " is not a packed model of this version!" << std::endl;
+        return nets;
+    }
+    uint32_t file_flags = reader.u32();
+    uint32_t count = reader.u32();
+
+    for(uint32_t n = 0; n < count && reader.ok(); n++)
+    {
+        std::shared_ptr<Net> net(new Net());
+        if(!net->Init(reader.string(), TEST))
+        {
+            std::cout << "Error: Can not parse the net " << n << " of " << file << "!" << std::endl;
+            return std::vector<std::shared_ptr<Net>>();
+        }
+
+        uint32_t records = reader.u32();
+        for(uint32_t r = 0; r < records && reader.ok(); r++)
+        {
+            std::string name = reader.string();
+            auto found = std::find(net->layer_names_.begin(), net->layer_names_.end(), name);
+            Layer<Dtype>* layer = found == net->layer_names_.end() ? nullptr : net->layers_[found - net->layer_names_.begin()].get();
+
+            if(reader.u32() == 0)
+            {
+                std::vector<std::shared_ptr<Blob<Dtype>>> blobs(reader.u32());
+                for(auto& blob : blobs)
+                {
+                    std::vector<int> shape(reader.u32());
+                    for(int& dim : shape)
+                        dim = reader.u32();
+                    blob = std::make_shared<Blob<Dtype>>();
+                    blob->Reshape(shape);
+                    if(const float* data = reader.array<float>(blob->count()))
+                        std::copy(data, data + blob->count(), blob->mutable_cpu_data());
+                }
+                if(layer)
+                    layer->blobs_ = blobs;
+                continue;
+            }
+
+            auto packed = std::make_shared<typename Layer<Dtype>::Packed>();
+            packed->inputs = reader.u32();
+            packed->outputs = reader.u32();
+            packed->input_range = reader.f32();
+            packed->weight = reader.array<float>((size_t)packed->inputs * packed->outputs);
+            uint32_t biases = reader.u32();
+            const float* bias = reader.array<float>(biases);
+            uint32_t slopes = reader.u32();
+            const float* slope = reader.array<float>(slopes);
+            if(bias)
+                packed->bias.assign(bias, bias + biases);
+            if(slope)
+                packed->slope.assign(slope, slope + slopes);
+            if(reader.u32())
+            {
+                packed->input_scale = reader.f32();
+                const float* scale = reader.array<float>(packed->outputs);
+                packed->weight_q = reader.array<int16_t>((size_t)packed->inputs * packed->outputs);
+                if(scale)
+                    packed->output_scale.assign(scale, scale + packed->outputs);
+                packed->quantized = packed->weight_q != nullptr;
+            }
+            if(!layer || !reader.ok())
+                continue;
+
+            //the packed weights should fit the layer of the prototxt
+            const Blob<Dtype>& bottom = *net->blobs_[layer->bottoms_[0]];
+            int inputs = std::string(layer->type()) == "Convolution" ? layer->kernel_ * layer->kernel_ * bottom.channels()
+                                                                     : bottom.count() / std::max(bottom.num(), 1);
+            if(packed->outputs != layer->num_output_ || packed->inputs != inputs)
+            {
+                std::cout << "Error: The packed weights of " << name << " do not fit the layer!" << std::endl;
+                return std::vector<std::shared_ptr<Net>>();
+            }
+
+            std::call_once(packed->once, [] {});
+            packed->mapping = mapping;
+            layer->packed_ = packed;
+            layer->blobs_.clear();
+        }
+
+        nets.push_back(net);
+    }
+
+    if(!reader.ok())
+    {
+        std::cout << "Error: " << file << " is broken!" << std::endl;
+        return std::vector<std::shared_ptr<Net>>();
+    }
+    if(flags)
+        *flags = file_flags;
+    return nets;
+}
+
+template class Net<float>;
+
+}
@@ -0,0 +1,222 @@
+//
+// A small inference engine for the layers of the MTCNN nets, which could be built instead of Caffe
+//
+
+#ifndef MTCNN_LITENET_H
+#define MTCNN_LITENET_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * litenet runs the nets of MTCNN on the CPU without Caffe. It reads the prototxt and the caffemodel of Caffe and
+ * has the part of the interface of Caffe which MTCNN uses, so the detector is built on either of them by the
+ * USE_LITENET option of cmake. The layers are the ones of det1 - det4: Convolution, PReLU, Pooling (MAX),
+ * InnerProduct, Softmax, Concat, Slice and Dropout.
+ *
+ * The input and the output blobs are in the NCHW order of Caffe, the blobs between the layers are in the NHWC
+ * order. A convolution is computed directly on its input, the weights are reordered once so the innermost loop
+ * runs over the output channels, which the compiler vectorizes, and a PReLU in place after a convolution or an
+ * inner product is done in the same pass.
+ *
+ * The convolutions and the inner products could be changed to int8 after a calibration, see Quantize().
+ */
+namespace litenet {
+
+using std::vector;
+using std::string;
+using std::shared_ptr;
+
+enum Phase { TRAIN, TEST };
+
+//the mode is kept for the same calls as Caffe, the engine runs on the CPU only
+class Caffe {
+public:
+    enum Brew { CPU, GPU };
+    static void set_mode(Brew mode) {}
+};
+
+template <typename Dtype>
+class Blob {
+public:
+    void Reshape(int num, int channels, int height, int width)
+    {
+        Reshape(std::vector<int>{num, channels, height, width});
+    }
+
+    //the memory is kept when the blob shrinks, so a reshape to a known shape never allocates
+    void Reshape(const std::vector<int>& shape)
+    {
+        shape_ = shape;
+        count_ = 1;
+        for(int dim : shape_)
+            count_ *= dim;
+        data_.resize(count_);
+    }
+
+    int num_axes() const { return shape_.size(); }
+    int shape(int axis) const { return axis < shape_.size() ? shape_[axis] : 1; }
+    const std::vector<int>& shape() const { return shape_; }
+    int num() const { return shape(0); }
+    int channels() const { return shape(1); }
+    int height() const { return shape(2); }
+    int width() const { return shape(3); }
+    int count() const { return count_; }
+
+    const Dtype* cpu_data() const { return data_.data(); }
+    Dtype* mutable_cpu_data() { return data_.data(); }
+
+private:
+    std::vector<int> shape_;
+    std::vector<Dtype> data_;
+    int count_ = 0;
+};
+
+class LayerParameter {
+public:
+    const std::string& name() const { return name_; }
+    const std::string& type() const { return type_; }
+
+    std::string name_;
+    std::string type_;
+};
+
+template <typename Dtype>
+class Net;
+
+template <typename Dtype>
+class Layer {
+public:
+    std::vector<std::shared_ptr<Blob<Dtype>>>& blobs() { return blobs_; }
+    const LayerParameter& layer_param() const { return param_; }
+    const char* type() const { return param_.type().c_str(); }
+
+private:
+    friend class Net<Dtype>;
+
+    //the weights in the order of the kernel, which are made at the first forward and shared by the replicas
+    struct Packed {
+        std::once_flag once;
+        int inputs = 0;
+        int outputs = 0;
+
+        //[in][out], in the storage or in the mapped file of LoadPacked()
+        const Dtype* weight = nullptr;
+        std::vector<Dtype> weight_storage;
+        std::shared_ptr<const void> mapping;
+        std::vector<Dtype> bias;
+        std::vector<Dtype> slope;
+
+        //the largest absolute input seen by the calibration
+        std::atomic<bool> calibrating{false};
+        std::mutex range_mutex;
+        Dtype input_range = 0;
+
+        //the int8 weights in int16, one row per output in the order of the patch, and the scale of the input and
+        //every output
+        std::atomic<bool> quantized{false};
+        const int16_t* weight_q = nullptr;
+        std::vector<int16_t> weight_q_storage;
+        Dtype input_scale = 0;
+        std::vector<Dtype> output_scale;
+    };
+
+    LayerParameter param_;
+    std::vector<std::shared_ptr<Blob<Dtype>>> blobs_;
+    std::shared_ptr<Packed> packed_ = std::make_shared<Packed>();
+
+    //param of the layer
+    int num_output_ = 0;
+    int kernel_ = 1;
+    int stride_ = 1;
+    int pad_ = 0;
+    int axis_ = 1;
+    bool max_pool_ = true;
+    std::vector<int> slice_points_;
+
+    //the ids of the blobs, the PReLU done by this layer, and true if this PReLU is done by the layer before it
+    std::vector<int> bottoms_;
+    std::vector<int> tops_;
+    int prelu_ = -1;
+    bool fused_ = false;
+};
+
+template <typename Dtype>
+class Net {
+public:
+    //a file which can not be read throws std::runtime_error, as does the forward of a layer without its weights
+    Net(const std::string& param_file, Phase phase, const int level = 0, const std::vector<std::string>* stages = NULL);
+
+    void CopyTrainedLayersFrom(const std::string& trained_file);
+    void ShareTrainedLayersWith(const Net* other);
+
+    void Reshape();
+    const std::vector<Blob<Dtype>*>& Forward(Dtype* loss = NULL);
+
+    /*
+     * Calibrate() starts or stops recording the range of the inputs of the convolutions and the inner products.
+     * The range is kept with the weights, so the forwards of all the replicas of the net are recorded.
+     * Quantize() then changes these layers to int8, the weights with a scale per output channel and the input
+     * with the scale of its range, for this net and all its replicas. Neither should run during a forward
+     */
+    void Calibrate(bool on);
+    bool Quantize();
+    bool quantized() const;
+
+    //a new net of the same layers, the blobs are its own and the weights are shared with this net
+    std::shared_ptr<Net> Replicate() const;
+
+    /*
+     * SavePacked() writes the nets with their packed weights, in int8 if they are quantized, to one file in which
+     * the weights are aligned for the kernels. LoadPacked() maps this file read-only and the nets use the weights
+     * where they are, so nothing is parsed, copied or packed, and the processes which load the same file share
+     * one copy of it in the page cache. The flags are kept for the caller
+     */
+    static bool SavePacked(const std::string& file, const std::vector<Net*>& nets, uint32_t flags);
+    static std::vector<std::shared_ptr<Net>> LoadPacked(const std::string& file, uint32_t* flags);
+
+    const std::vector<Blob<Dtype>*>& input_blobs() const { return input_blobs_; }
+    const std::vector<Blob<Dtype>*>& output_blobs() const { return output_blobs_; }
+    const std::vector<std::shared_ptr<Layer<Dtype>>>& layers() const { return layers_; }
+    const std::vector<std::string>& layer_names() const { return layer_names_; }
+    const std::vector<std::string>& blob_names() const { return blob_names_; }
+    const std::vector<std::vector<Blob<Dtype>*>>& bottom_vecs() const { return bottom_vecs_; }
+    const std::vector<std::vector<Blob<Dtype>*>>& top_vecs() const { return top_vecs_; }
+    const std::string& name() const { return name_; }
+
+private:
+    Net() {}
+    bool Init(const std::string& prototxt, Phase phase);
+
+    std::vector<int> patch_order(const Layer<Dtype>& layer) const;
+    void pack(Layer<Dtype>& layer);
+    void pack_int8(Layer<Dtype>& layer);
+
+    std::string name_;
+    std::string prototxt_;
+    Phase phase_ = TEST;
+    std::vector<std::shared_ptr<Layer<Dtype>>> layers_;
+    std::vector<std::string> layer_names_;
+    std::vector<std::shared_ptr<Blob<Dtype>>> blobs_;
+    std::vector<std::string> blob_names_;
+
+    //true for the blobs in the NCHW order, which are the input and the output blobs
+    std::vector<bool> planar_;
+
+    std::vector<std::vector<Blob<Dtype>*>> bottom_vecs_;
+    std::vector<std::vector<Blob<Dtype>*>> top_vecs_;
+    std::vector<Blob<Dtype>*> input_blobs_;
+    std::vector<Blob<Dtype>*> output_blobs_;
+
+    //the int8 input of a quantized layer in int16
+    std::vector<int16_t> input_q_;
+};
+
+}
+
+
+#endif //MTCNN_LITENET_H
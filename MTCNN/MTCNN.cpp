@@ -7,86 +7,46 @@
  */
 
 #include "MTCNN.h"
+#include <climits>
 
-MTCNN::MTCNN(){
-    //the vector used to input the address of the net model
-    vector<string> model_file = {
-            "./MTCNN/model/det1.prototxt",
-            "./MTCNN/model/det2.prototxt",
-            "./MTCNN/model/det3.prototxt"
-    };
-
-    //the vector used to input the address of the net parameters
-    vector<string> trained_file = {
-            "./MTCNN/model/det1.caffemodel",
-            "./MTCNN/model/det2.caffemodel",
-            "./MTCNN/model/det3.caffemodel"
-    };
-
-    #ifdef CPU_ONLY
-        Caffe::set_mode(Caffe::CPU);
-    #else
-        Caffe::set_mode(Caffe::GPU);
-    #endif
-
-    for(int i = 0; i < model_file.size(); i++)
-    {
-        std::shared_ptr<Net<float>> net;
-
-        cv::Size input_geometry;
-        int num_channel;
-
-        net.reset(new Net<float>(model_file[i], TEST));
-        net->CopyTrainedLayersFrom(trained_file[i]);
-
-        Blob<float>* input_layer = net->input_blobs()[0];
-        num_channel = input_layer->channels();
-        input_geometry = cv::Size(input_layer->width(), input_layer->height());
-
-        nets_.push_back(net);
-        input_geometry_.push_back(input_geometry);
-        if(i == 0)
-            num_channels_ = num_channel;
-        else if(num_channels_ != num_channel)
-            std::cout << "Error: The number channels of the nets are different!" << std::endl;
-    }
+MTCNN::MTCNN()
+        : MTCNN(std::make_shared<MTCNNModel>())
+{
 }
 
 MTCNN::MTCNN(const std::vector<std::string> model_file, const std::vector<std::string> trained_file)
+        : MTCNN(std::make_shared<MTCNNModel>(model_file, trained_file))
 {
-    #ifdef CPU_ONLY
-        Caffe::set_mode(Caffe::CPU);
-    #else
-        Caffe::set_mode(Caffe::GPU);
-    #endif
-
-    for(int i = 0; i < model_file.size(); i++)
-    {
-        std::shared_ptr<Net<float>> net;
-
-        cv::Size input_geometry;
-        int num_channel;
-
-        net.reset(new Net<float>(model_file[i], TEST));
-        net->CopyTrainedLayersFrom(trained_file[i]);
-
-        Blob<float>* input_layer = net->input_blobs()[0];
-        num_channel = input_layer->channels();
-        input_geometry = cv::Size(input_layer->width(), input_layer->height());
+}
 
-        nets_.push_back(net);
-        input_geometry_.push_back(input_geometry);
-        if(i == 0)
-            num_channels_ = num_channel;
-        else if(num_channels_ != num_channel)
-            std::cout << "Error: The number channels of the nets are different!" << std::endl;
-    }
+/*
+ * MTCNN(std::shared_ptr<const MTCNNModel> model) function
+ * used to create a detector on a loaded model, the nets of the detector are replicas which share the weights
+ * of the model, so only the blobs of the forward are allocated for every detector
+ */
+MTCNN::MTCNN(std::shared_ptr<const MTCNNModel> model)
+{
+    model_ = model;
+    model_file_ = model->model_file_;
+    row_major_ = model->row_major_;
+
+    //R-Net and O-Net of the model may still be loading, their replicas are created when they are used
+    nets_.assign(model->size(), nullptr);
+    batch_nets_.assign(model->size(), nullptr);
+    input_geometry_.assign(model->size(), cv::Size());
+    stage(0);
+    num_channels_ = model->num_channels_;
 }
 
 MTCNN::~MTCNN(){}
 
 void MTCNN::detection(const cv::Mat& img, std::vector<cv::Rect>& rectangles)
 {
+    //nothing of the last call is kept, so a detector could serve any stream
+    bounding_box_.clear();
+    confidence_.clear();
+    alignment_.clear();
+
     Preprocess(img);
     P_Net();
     local_NMS();
@@ -99,7 +59,7 @@ void MTCNN::detection(const cv::Mat& img, std::vector<cv::Rect>& rectangles)
     rectangles.clear();
     for(auto &bounding_box : bounding_box_)
     {
-        rectangles.push_back(cv::Rect(bounding_box.y, bounding_box.x, bounding_box.height, bounding_box.width));
+        rectangles.push_back(to_frame(bounding_box));
     }
 }
 
@@ -120,7 +80,7 @@ void MTCNN::detection(const cv::Mat& img, std::vector<cv::Rect>& rectangles, std
         std::vector<cv::Point> temp_alignment;
         for(auto &j : i)
         {
-            temp_alignment.push_back(cv::Point(j.y, j.x));
+            temp_alignment.push_back(row_major_ ? j : cv::Point(j.y, j.x));
         }
         alignment.push_back(std::move(temp_alignment));
     }
@@ -129,6 +89,10 @@ void MTCNN::detection(const cv::Mat& img, std::vector<cv::Rect>& rectangles, std
 
 void MTCNN::detection_TEST(const cv::Mat& img, std::vector<cv::Rect>& rectangles)
 {
+    bounding_box_.clear();
+    confidence_.clear();
+    alignment_.clear();
+
     Preprocess(img);
     P_Net();
     img_show_T(img, "P-Net");
@@ -145,6 +109,50 @@ void MTCNN::detection_TEST(const cv::Mat& img, std::vector<cv::Rect>& rectangles
 
 }
 
+/*
+ * detection_ROI() function
+ * used to detect the faces around the given regions only, such as the areas of the trackers, instead of the
+ * whole frame. P-Net searches a padded crop of every region for the faces of about the size of the region,
+ * R-Net and O-Net are the same as the full detection. The new faces out of the regions are not found, so a full
+ * detection should be run once in a while
+ */
+void MTCNN::detection_ROI(const cv::Mat& img, const std::vector<cv::Rect>& regions, std::vector<cv::Rect>& rectangles)
+{
+    bounding_box_.clear();
+    confidence_.clear();
+    alignment_.clear();
+
+    Preprocess(img);
+
+    //the regions in the image of the nets
+    std::vector<cv::Rect> regions_net;
+    for(auto &region : regions)
+    {
+        regions_net.push_back(to_frame(region));
+    }
+
+    P_Net_ROI(regions_net);
+    local_NMS();
+    R_Net();
+    local_NMS();
+    O_Net();
+    global_NMS();
+
+
+    rectangles.clear();
+    for(auto &bounding_box : bounding_box_)
+    {
+        rectangles.push_back(to_frame(bounding_box));
+    }
+}
+
+void MTCNN::detection_ROI(const cv::Mat& img, const std::vector<cv::Rect>& regions, std::vector<cv::Rect>& rectangles, std::vector<float>& confidence)
+{
+    detection_ROI(img, regions, rectangles);
+
+    confidence = confidence_;
+}
+
 void MTCNN::Preprocess(const cv::Mat &img)
 {
     /* Convert the input image to the input image format of the network. */
@@ -160,29 +168,312 @@ void MTCNN::Preprocess(const cv::Mat &img)
     else
         sample = img;
 
-    cv::Mat sample_float;
-    if (num_channels_ == 3)
-        sample.convertTo(sample_float, CV_32FC3);
-    else
-        sample.convertTo(sample_float, CV_32FC1);
+    //the frame is kept as it is, the float, RGB and transposed image of the nets is made by fill_input() only
+    //for the pixels of the inputs
+    if (sample.depth() != CV_8U)
+        sample.convertTo(sample, CV_8U);
+
+    frame_ = sample;
+    img_size_ = row_major_ ? frame_.size() : cv::Size(frame_.rows, frame_.cols);
 
+    //the octaves are built down to the cell of P-Net, or the frame alone is the pyramid without the cascade
+    if(next_pyramid_ && next_pyramid_->is_of(frame_))
+        pyramid_ = next_pyramid_;
+    else
+        pyramid_ = std::make_shared<FramePyramid>(frame_, cascade_pyramid_ ? input_geometry_[0].width : INT_MAX);
+    next_pyramid_.reset();
+}
 
-    cv::cvtColor(sample_float,sample_float,cv::COLOR_BGR2RGB);
-    sample_float = sample_float.t();
+/*
+ * use_pyramid() function
+ * used to share the octaves of the next frame with the other consumers of it, the pyramid is used only if it
+ * is built on the same buffer of the frame, and only for the next call
+ */
+void MTCNN::use_pyramid(std::shared_ptr<const FramePyramid> pyramid)
+{
+    next_pyramid_ = pyramid;
+}
 
-    img_ = sample_float;
+/*
+ * to_frame() function
+ * used to change a box between the image of the nets and the frame, which are the same for the row-major nets
+ * and the transposed ones of each other otherwise
+ */
+cv::Rect MTCNN::to_frame(const cv::Rect& rect)
+{
+    if(row_major_)
+        return rect;
+    return cv::Rect(rect.y, rect.x, rect.height, rect.width);
 }
 
 void MTCNN::P_Net()
 {
-    resize_img();
+    if(pack_scales_)
+    {
+        //one forward over the canvas of all the scales
+        pack_img();
+        if(pack_rects_.empty())
+            return;
+        Predict(plan_P_Net(pack_size_), pack_sources_, pack_rects_, pack_size_, regression_box_temp_, confidence_temp_);
+
+        int stride = 2;
+        int cellSize = input_geometry_[0].width;
+        int feature_map_w = std::ceil((pack_size_.width - cellSize)*1.0/stride)+1;
+        for(int k = 0; k < pack_rects_.size(); k++)
+            GenerateBoxs(pack_rects_[k], pack_sources_[k], feature_map_w);
+        return;
+    }
+
+    if(p_net_workers_ > 1)
+    {
+        P_Net_parallel();
+        return;
+    }
+
+    cv::Rect whole(0, 0, img_size_.width, img_size_.height);
+    for(auto &size : pyramid_sizes())
+    {
+        cv::Rect placement(cv::Point(0, 0), size);
+        Predict(plan_P_Net(size), std::vector<cv::Rect>(1, whole), std::vector<cv::Rect>(1, placement), size,
+                regression_box_temp_, confidence_temp_);
 
-    for(auto img_resized : img_resized_){
-        Predict(img_resized, 0);
-        GenerateBoxs(img_resized);
+        int feature_map_w = std::ceil((size.width - input_geometry_[0].width)*1.0/2)+1;
+        GenerateBoxs(placement, whole, feature_map_w);
     }
 }
 
+/*
+ * P_Net_parallel() function
+ * used to run the scales of the image pyramid on the replicas of P-Net at the same time. The workers run on the
+ * threads of cv::parallel_for_, so no thread is created for a detection. Every worker takes the next scale,
+ * resizes it and keeps its boxes in the place of this scale, the boxes are appended in the order of the scales
+ * afterwards, so the result is the same as the serial loop.
+ */
+void MTCNN::P_Net_parallel()
+{
+    std::vector<cv::Size> sizes = pyramid_sizes();
+    int scales = sizes.size();
+
+    //every scale has its own net, which is forwarded by one worker at a time
+    std::vector<Net<float>*> plans;
+    for(auto &size : sizes)
+        plans.push_back(plan_P_Net(size));
+
+    std::vector<std::vector<cv::Rect>> bounding_boxes(scales);
+    std::vector<std::vector<float>> confidences(scales);
+    std::atomic<int> next_scale(0);
+
+    //the workers run on the threads of OpenCV, every one takes the next scale until all of them are done
+    int workers = std::min(p_net_workers_, scales);
+    cv::parallel_for_(cv::Range(0, workers), [&](const cv::Range& range)
+    {
+        //the mode of caffe is kept per thread
+        #ifdef CPU_ONLY
+            Caffe::set_mode(Caffe::CPU);
+        #else
+            Caffe::set_mode(Caffe::GPU);
+        #endif
+
+        std::vector<float> regression_map, confidence_map;
+        NMS nms;
+
+        cv::Rect whole(0, 0, img_size_.width, img_size_.height);
+
+        for(int s = next_scale++; s < scales; s = next_scale++)
+        {
+            cv::Rect placement(cv::Point(0, 0), sizes[s]);
+            Predict(plans[s], std::vector<cv::Rect>(1, whole), std::vector<cv::Rect>(1, placement), sizes[s],
+                    regression_map, confidence_map);
+
+            int feature_map_w = std::ceil((sizes[s].width - input_geometry_[0].width)*1.0/2)+1;
+            GenerateBoxs(placement, whole, feature_map_w,
+                         regression_map, confidence_map, bounding_boxes[s], confidences[s]);
+            nms.apply(bounding_boxes[s], confidences[s], nullptr, threshold_NMS_, NMS::NEVER, 0.96);
+        }
+    }, workers);
+
+    for(int s = 0; s < scales; s++)
+    {
+        confidence_.insert(confidence_.end(), confidences[s].begin(), confidences[s].end());
+        bounding_box_.insert(bounding_box_.end(), bounding_boxes[s].begin(), bounding_boxes[s].end());
+    }
+}
+
+/*
+ * P_Net_ROI() function
+ * used to run P-Net on the padded regions only, the scales of every region are packed in one canvas, so all the
+ * regions cost one forward as the packed scales of the whole image. The canvas is forwarded on a planned replica
+ */
+void MTCNN::P_Net_ROI(const std::vector<cv::Rect>& regions)
+{
+    std::vector<cv::Rect> sources;
+    std::vector<cv::Size> sizes;
+    roi_pyramid(regions, sources, sizes);
+
+    pack_img(sources, sizes);
+    if(pack_rects_.empty())
+        return;
+
+    //the canvas follows the regions, so it is rounded up to a step of an eighth of its side at least, and the
+    //planned replicas of a few sizes are reused instead of reshaping the net at every call. The rest is zero
+    cv::Size canvas = pack_size_;
+    for(int* side : {&canvas.width, &canvas.height})
+    {
+        int step = 32;
+        while(step * 8 <= *side)
+            step *= 2;
+        *side = (*side + step - 1) / step * step;
+    }
+    Predict(plan_P_Net(canvas), pack_sources_, pack_rects_, canvas, regression_box_temp_, confidence_temp_);
+
+    int stride = 2;
+    int cellSize = input_geometry_[0].width;
+    int feature_map_w = std::ceil((canvas.width - cellSize)*1.0/stride)+1;
+    for(int k = 0; k < pack_rects_.size(); k++)
+        GenerateBoxs(pack_rects_[k], pack_sources_[k], feature_map_w);
+}
+
+/*
+ * set_P_Net_workers() function
+ * used to set the number of threads of the parallel scales, every scale is forwarded on its own planned net,
+ * so a worker never shares a net with another one. The parallel mode is used when workers > 1 and the scales are
+ * not packed, which is the default, see set_pack_scales(). The workers run on the threads of OpenCV, so there are
+ * cv::getNumThreads() of them at most
+ */
+void MTCNN::set_P_Net_workers(int workers)
+{
+    p_net_workers_ = std::max(1, workers);
+}
+
+/*
+ * set_pack_scales() function
+ * used to run all the scales of the full detection as one forward over a canvas, see pack_img(). It is off by
+ * default, as the cells at the edge of a scale of odd size are close to the forward of the scale alone but not
+ * the same, so the boxes and the confidences may differ a little
+ */
+void MTCNN::set_pack_scales(bool pack)
+{
+    pack_scales_ = pack;
+}
+
+/*
+ * plan_P_Net() function
+ * used to get the replica of P-Net which is reshaped to the input size, the replica is created and reshaped at the
+ * first call of the size only, so a scale of a known resolution never reshapes the blobs
+ */
+Net<float>* MTCNN::plan_P_Net(const cv::Size& input_size)
+{
+    std::shared_ptr<Net<float>>& net = p_net_plans_[std::make_pair(input_size.height, input_size.width)];
+    if(!net)
+    {
+        net = model_->replicate(0);
+        net->input_blobs()[0]->Reshape(1, num_channels_, input_size.height, input_size.width);
+        net->Reshape();
+    }
+    return net.get();
+}
+
+/*
+ * stage() function
+ * used to get the replica of the i-th net of the model, which is created at the first use, so the first frames go
+ * through P-Net while R-Net and O-Net of the model are still loading
+ */
+Net<float>* MTCNN::stage(int i)
+{
+    if(!nets_[i])
+    {
+        input_geometry_[i] = model_->input_geometry(i);
+        nets_[i] = model_->replicate(i);
+    }
+    return nets_[i].get();
+}
+
+/*
+ * plan_batch() function
+ * used to get the replica of R-Net or O-Net which is reshaped to a batch of the bucket of count, the buckets are the
+ * powers of two up to max_batch_. There is one replica for every net, which is sized to max_batch_ when it is
+ * created, the blobs keep their memory when they shrink, so a reshape to a bucket never allocates
+ */
+Net<float>* MTCNN::plan_batch(int i, int count)
+{
+    stage(i);
+
+    int bucket = 1;
+    while(bucket < count && bucket < max_batch_)
+        bucket *= 2;
+
+    std::shared_ptr<Net<float>>& net = batch_nets_[i];
+    if(!net)
+    {
+        net = model_->replicate(i);
+        net->input_blobs()[0]->Reshape(max_batch_, num_channels_, input_geometry_[i].height, input_geometry_[i].width);
+        net->Reshape();
+    }
+    if(net->input_blobs()[0]->num() != bucket)
+    {
+        net->input_blobs()[0]->Reshape(bucket, num_channels_, input_geometry_[i].height, input_geometry_[i].width);
+        net->Reshape();
+    }
+    return net.get();
+}
+
+/*
+ * warm_up() function
+ * used to plan and forward once all the nets of the frames of frame_size, the scales of P-Net in the mode of now and
+ * the largest bucket of R-Net and O-Net, so the first frames do not allocate the blobs
+ */
+void MTCNN::warm_up(const cv::Size& frame_size)
+{
+    img_size_ = row_major_ ? frame_size : cv::Size(frame_size.height, frame_size.width);
+
+    std::vector<cv::Size> input_sizes;
+    if(pack_scales_)
+    {
+        pack_img();
+        if(!pack_rects_.empty())
+            input_sizes.push_back(pack_size_);
+    }
+    else
+    {
+        input_sizes = pyramid_sizes();
+    }
+
+    for(auto &size : input_sizes)
+    {
+        Net<float>* net = plan_P_Net(size);
+        Blob<float>* input_layer = net->input_blobs()[0];
+        std::fill(input_layer->mutable_cpu_data(), input_layer->mutable_cpu_data() + input_layer->count(), 0.f);
+        net->Forward();
+    }
+
+    for(int i = 1; i < nets_.size(); i++)
+    {
+        Net<float>* net = plan_batch(i, max_batch_);
+        Blob<float>* input_layer = net->input_blobs()[0];
+        std::fill(input_layer->mutable_cpu_data(), input_layer->mutable_cpu_data() + input_layer->count(), 0.f);
+        net->Forward();
+    }
+}
+
+/*
+ * quantize() function
+ * used to change R and O net of the model to int8, the range of their inputs is calibrated on the candidates of
+ * the frames, which should look like the frames to detect and hold faces. The detectors on the model are changed
+ * too, so it should be called before they run. It needs LiteNet, see MTCNNModel::quantize()
+ */
+bool MTCNN::quantize(std::shared_ptr<MTCNNModel> model, const std::vector<cv::Mat>& frames)
+{
+    MTCNN detector(model);
+    std::vector<cv::Rect> rectangles;
+
+    model->calibrate(true);
+    for(const auto& frame : frames)
+        detector.detection(frame, rectangles);
+    model->calibrate(false);
+
+    return model->quantize();
+}
+
 void MTCNN::R_Net()
 {
     detect_net(1);
@@ -198,28 +489,24 @@ void MTCNN::detect_net(int i)
     float thresh = threshold_[i];
     std::vector<cv::Rect> bounding_box;
     std::vector<float> confidence;
-    std::vector<cv::Mat> cur_imgs;
     std::vector<std::vector<cv::Point>> alignment;
 
-    if(bounding_box_.size() == 0)
-        return;
-
+    //a box without area has no input, the j-th input is the j-th box afterwards
     for (int j = 0; j < bounding_box_.size(); j++) {
-        cv::Mat img = crop(img_, bounding_box_[j]);
-        if (img.size() == cv::Size(0,0))
-            continue;
-        if (img.rows == 0 || img.cols == 0)
-            continue;
-        if (img.size() != input_geometry_[i])
-            cv::resize(img, img, input_geometry_[i]);
-        img.convertTo(img, CV_32FC3, 0.0078125,-127.5*0.0078125);
-        cur_imgs.push_back(img);
+        if (bounding_box_[j].width > 0 && bounding_box_[j].height > 0) {
+            bounding_box.push_back(bounding_box_[j]);
+            confidence.push_back(confidence_[j]);
+        }
     }
+    bounding_box_.swap(bounding_box);
+    confidence_.swap(confidence);
+    bounding_box.clear();
+    confidence.clear();
 
-//    std::vector<cv::Mat> cur_imgs_test;
-//    cur_imgs_test.push_back(cur_imgs[0]);
+    if(bounding_box_.size() == 0)
+        return;
 
-    Predict(cur_imgs, i);
+    Predict(bounding_box_, i);
 
     for(int j = 0; j < confidence_temp_.size()/2; j++)
     {
@@ -264,106 +551,32 @@ void MTCNN::detect_net(int i)
         }
     }
 
-    cur_imgs.clear();
-
     bounding_box_ = bounding_box;
     confidence_ = confidence;
     alignment_ = alignment;
 }
 
 
+/*
+ * local_NMS() function
+ * used to suppress the candidates of P-Net and R-Net by the IoU, a candidate with the confidence of 0.96 or more
+ * is never suppressed
+ */
 void MTCNN::local_NMS()
 {
-    std::vector<cv::Rect> cur_rects = bounding_box_;
-    std::vector<float> confidence = confidence_;
-    float threshold = threshold_NMS_;
-
-    for(int i = 0; i < cur_rects.size(); i++)
-    {
-        for(int j = i + 1; j < cur_rects.size(); )
-        {
-            if(IoU(cur_rects[i], cur_rects[j]) > threshold)
-            {
-                float a = IoU(cur_rects[i], cur_rects[j]);
-//                if(confidence[i] == confidence[j])
-//                {
-//                    cur_rects.erase(cur_rects.begin() + j);
-//                    confidence.erase(confidence.begin() + j);
-//                }
-                if(confidence[i] >= confidence[j] && confidence[j] < 0.96)
-                {
-                    cur_rects.erase(cur_rects.begin() + j);
-                    confidence.erase(confidence.begin() + j);
-                }
-                else if (confidence[i] < confidence[j] && confidence[i] < 0.96)
-                {
-                    cur_rects.erase(cur_rects.begin() + i);
-                    confidence.erase(confidence.begin() + i);
-                    i--;
-                    break;
-                }
-                else
-                {
-                    j++;
-                }
-            }
-            else
-            {
-                j++;
-            }
-
-        }
-    }
-
-    bounding_box_ = cur_rects;
-    confidence_ = confidence;
-
+    nms_.apply(bounding_box_, confidence_, nullptr, threshold_NMS_, NMS::NEVER, 0.96);
 }
 
+/*
+ * global_NMS() function
+ * used to suppress the faces of O-Net by the IoU or the IoM, so a small box inside a face is suppressed too
+ */
 void MTCNN::global_NMS()
 {
-    std::vector<cv::Rect> cur_rects = bounding_box_;
-    std::vector<float> confidence = confidence_;
-    std::vector<std::vector<cv::Point>> alignment = alignment_;
     float threshold_IoM = threshold_NMS_;
     float threshold_IoU = threshold_NMS_ - 0.1;
 
-
-    for(int i = 0; i < cur_rects.size(); i++)
-    {
-        for(int j = i + 1; j < cur_rects.size(); )
-        {
-            if(IoU(cur_rects[i], cur_rects[j]) > threshold_IoU || IoM(cur_rects[i], cur_rects[j]) > threshold_IoM)
-            {
-                if(confidence[i] >= confidence[j])// && confidence[j] < 0.85) //if confidence[i] == confidence[j], it keeps the small one
-                {
-                    cur_rects.erase(cur_rects.begin() + j);
-                    alignment.erase(alignment.begin() + j);
-                    confidence.erase(confidence.begin() + j);
-                }
-                else if(confidence[i] < confidence[j])// && confidence[i] < 0.85)
-                {
-                    cur_rects.erase(cur_rects.begin() + i);
-                    alignment.erase(alignment.begin() + i);
-                    confidence.erase(confidence.begin() + i);
-                    i--;
-                    break;
-                }
-                else
-                {
-                    j++;
-                }
-            }
-            else
-            {
-                j++;
-            }
-        }
-    }
-
-    bounding_box_ = cur_rects;
-    confidence_ = confidence;
-    alignment_ = alignment;
+    nms_.apply(bounding_box_, confidence_, &alignment_, threshold_IoU, threshold_IoM);
 }
 
 
@@ -373,8 +586,16 @@ void MTCNN::global_NMS()
  */
 void MTCNN::Predict(const cv::Mat& img, int i)
 {
-    std::shared_ptr<Net<float>> net = nets_[i];
+    Predict(stage(i), img, regression_box_temp_, confidence_temp_);
+}
 
+/*
+ * Predict(Net<float>* net, const cv::Mat& img, ...) function
+ * used to forward a image without crop through a P-Net instance, the outputs are written to the given vectors
+ * rather than the members, so the replicas of P-Net could run at the same time
+ */
+void MTCNN::Predict(Net<float>* net, const cv::Mat& img, std::vector<float>& regression_box, std::vector<float>& confidence_map)
+{
     Blob<float>* input_layer = net->input_blobs()[0];
     input_layer->Reshape(1, num_channels_,
                          img.rows, img.cols);
@@ -382,7 +603,7 @@ void MTCNN::Predict(const cv::Mat& img, int i)
     net->Reshape();
 
     std::vector<cv::Mat> input_channels;
-    WrapInputLayer(img, &input_channels, i);
+    WrapInputLayer(net, img, &input_channels);
     net->Forward();
 
     /* Copy the output layer to a std::vector */
@@ -392,12 +613,94 @@ void MTCNN::Predict(const cv::Mat& img, int i)
 
     const float* rect_begin = rect->cpu_data();
     const float* rect_end = rect_begin + rect->channels() * count;
-    regression_box_temp_ = std::vector<float>(rect_begin, rect_end);
+    regression_box.assign(rect_begin, rect_end);
 
     const float* confidence_begin = confidence->cpu_data() + count;
     const float* confidence_end = confidence_begin + count;
 
-    confidence_temp_ = std::vector<float>(confidence_begin, confidence_end);
+    confidence_map.assign(confidence_begin, confidence_end);
+}
+
+/*
+ * Predict(Net<float>* net, sources, placements, input_size, ...) function
+ * used to forward an input of input_size through a P-Net instance, the k-th region sources[k] of the image is
+ * resized into placements[k] of the input straight from the frame. The rest of the input is zero
+ */
+void MTCNN::Predict(Net<float>* net, const std::vector<cv::Rect>& sources, const std::vector<cv::Rect>& placements,
+                    const cv::Size& input_size, std::vector<float>& regression_box, std::vector<float>& confidence_map)
+{
+    //a planned net has the shape already
+    Blob<float>* input_layer = net->input_blobs()[0];
+    if(input_layer->num() != 1 || input_layer->height() != input_size.height || input_layer->width() != input_size.width)
+    {
+        input_layer->Reshape(1, num_channels_,
+                             input_size.height, input_size.width);
+        /* Forward dimension change to all layers. */
+        net->Reshape();
+    }
+
+    float* input_data = input_layer->mutable_cpu_data();
+    if(placements.size() != 1 || placements[0].size() != input_size)
+        std::fill(input_data, input_data + input_layer->count(), 0.f);
+    //the places do not overlap, so they are filled at the same time
+    cv::parallel_for_(cv::Range(0, placements.size()), [&](const cv::Range& range)
+    {
+        for(int k = range.start; k < range.end; k++)
+            fill_input(sources[k], placements[k], input_data, input_size);
+    });
+
+    net->Forward();
+
+    /* Copy the output layer to a std::vector */
+    Blob<float>* rect = net->output_blobs()[0];
+    Blob<float>* confidence = net->output_blobs()[1];
+    int count = confidence->count() / 2;
+
+    const float* rect_begin = rect->cpu_data();
+    const float* rect_end = rect_begin + rect->channels() * count;
+    regression_box.assign(rect_begin, rect_end);
+
+    const float* confidence_begin = confidence->cpu_data() + count;
+    const float* confidence_end = confidence_begin + count;
+
+    confidence_map.assign(confidence_begin, confidence_end);
+}
+
+/*
+ * Predict(const std::vector<cv::Rect>& boxes, int i) function
+ * used to forward the crops of the boxes through R-Net or O-Net, every box of the image is resized to the
+ * input geometry straight from the frame into its place of the batch. The boxes are forwarded in the planned
+ * batches of max_batch_ at most, the places of a batch after the last box are not read
+ */
+void MTCNN::Predict(const std::vector<cv::Rect>& boxes, int i)
+{
+    stage(i);
+    int input_count = num_channels_ * input_geometry_[i].area();
+
+    confidence_temp_.clear();
+    regression_box_temp_.clear();
+    alignment_temp_.clear();
+
+    for(int first = 0; first < boxes.size(); first += max_batch_)
+    {
+        int count = std::min<int>(max_batch_, boxes.size() - first);
+        Net<float>* net = plan_batch(i, count);
+
+        //every box is resampled into its own place of the batch, so the boxes are filled at the same time
+        float* input_data = net->input_blobs()[0]->mutable_cpu_data();
+        cv::parallel_for_(cv::Range(0, count), [&](const cv::Range& range)
+        {
+            for(int j = range.start; j < range.end; j++)
+            {
+                fill_input(boxes[first + j], cv::Rect(cv::Point(0, 0), input_geometry_[i]), input_data + j * input_count,
+                           input_geometry_[i], false);
+            }
+        });
+
+        net->Forward();
+
+        ReadOutput(net, i, count);
+    }
 }
 
 /*
@@ -407,6 +710,7 @@ void MTCNN::Predict(const cv::Mat& img, int i)
  */
 void MTCNN::Predict(const std::vector<cv::Mat> imgs, int i)
 {
+    stage(i);
     std::shared_ptr<Net<float>> net = nets_[i];
 
     Blob<float>* input_layer = net->input_blobs()[0];
@@ -420,35 +724,51 @@ void MTCNN::Predict(const std::vector<cv::Mat> imgs, int i)
     WrapInputLayer(imgs, &input_channels, i);
 
     net->Forward();
-    
+
+    confidence_temp_.clear();
+    regression_box_temp_.clear();
+    alignment_temp_.clear();
+    ReadOutput(net.get(), i, imgs.size());
+}
+
+/*
+ * ReadOutput() function
+ * used to append the outputs of the first count images of the batch of R-Net or O-Net to the vectors of the members
+ */
+void MTCNN::ReadOutput(Net<float>* net, int i, int count)
+{
     /* Copy the output layer to a std::vector */
     //You can also try to use the blob_by_name()
 
-    //confidence
+    //confidence, the channel of confidence is two
     Blob<float>* confidence = net->output_blobs()[i];
-    int count = confidence->count() / 2; //the channel of confidence is two
     const float* confidence_begin = confidence->cpu_data();
     const float* confidence_end = confidence_begin + count * 2;
-    confidence_temp_ = std::vector<float>(confidence_begin, confidence_end);
+    confidence_temp_.insert(confidence_temp_.end(), confidence_begin, confidence_end);
 
     //regression_box
     Blob<float>* rect = net->output_blobs()[0];
     const float* rect_begin = rect->cpu_data();
     const float* rect_end = rect_begin + rect->channels() * count;
-    regression_box_temp_ = std::vector<float>(rect_begin, rect_end);
+    regression_box_temp_.insert(regression_box_temp_.end(), rect_begin, rect_end);
 
     //landmarks
     if( i == 2){
         Blob<float>* points = net->output_blobs()[1];
         const float* points_begin = points->cpu_data();
         const float* points_end = points_begin + points->channels() * count;
-        alignment_temp_ = std::vector<float>(points_begin, points_end);
+        alignment_temp_.insert(alignment_temp_.end(), points_begin, points_end);
     }
 }
 
 void MTCNN::WrapInputLayer(const cv::Mat& img, std::vector<cv::Mat> *input_channels, int i)
 {
-    Blob<float>* input_layer = nets_[i]->input_blobs()[0];
+    WrapInputLayer(stage(i), img, input_channels);
+}
+
+void MTCNN::WrapInputLayer(Net<float>* net, const cv::Mat& img, std::vector<cv::Mat> *input_channels)
+{
+    Blob<float>* input_layer = net->input_blobs()[0];
 
     int width = input_layer->width();
     int height = input_layer->height();
@@ -475,7 +795,7 @@ void MTCNN::WrapInputLayer(const cv::Mat& img, std::vector<cv::Mat> *input_chann
  */
 void MTCNN::WrapInputLayer(const vector<cv::Mat> imgs, std::vector<cv::Mat> *input_channels, int i)
 {
-    Blob<float> *input_layer = nets_[i]->input_blobs()[0];
+    Blob<float> *input_layer = stage(i)->input_blobs()[0];
 
     int width = input_layer->width();
     int height = input_layer->height();
@@ -515,72 +835,218 @@ float MTCNN::IoM(cv::Rect rect1, cv::Rect rect2)
     return float(intersection)/min_area;
 }
 
-void MTCNN::resize_img()
+/*
+ * pyramid_sizes() function
+ * used to get the size of every scale of the image pyramid, from the largest one. The scales are kept for the
+ * size of the image and the parameters, so the frames of a video compute them once
+ */
+std::vector<cv::Size> MTCNN::pyramid_sizes()
 {
-    cv::Mat img = img_;
-    int height = img.rows;
-    int width = img.cols;
+    if(img_size_ == planned_size_ && minSize_ == planned_minSize_ && factor_ == planned_factor_)
+        return planned_sizes_;
+
+    int height = img_size_.height;
+    int width = img_size_.width;
 
     int minSize = minSize_;
     float factor = factor_;
     double scale = 12./minSize;
     int minWH = std::min(height, width) * scale;
 
-    std::vector<cv::Mat> img_resized;
+    std::vector<cv::Size> sizes;
+    scale_.clear();
 
     while(minWH >= 12)
     {
         int resized_h = std::ceil(height*scale);
         int resized_w = std::ceil(width*scale);
 
-        cv::Mat resized;
-        cv::resize(img, resized, cv::Size(resized_w, resized_h), 0, 0, cv::INTER_AREA);
-        resized.convertTo(resized, CV_32FC3, 0.0078125,-127.5*0.0078125);
-        img_resized.push_back(resized);
+        sizes.push_back(cv::Size(resized_w, resized_h));
+        scale_.push_back(scale);
 
         minWH *= factor;
         scale *= factor;
     }
 
-    img_resized_ = img_resized;
+    planned_size_ = img_size_;
+    planned_minSize_ = minSize_;
+    planned_factor_ = factor_;
+    planned_sizes_ = sizes;
+
+    return sizes;
+}
+
+/*
+ * roi_pyramid() function
+ * used to get the padded crop of every region and the sizes it is resized to. The scales of a region make the
+ * faces from roi_face_range_[0] to roi_face_range_[1] times of the region 12 pixels, as the scales of the
+ * image pyramid do for the faces from minSize_ to the size of the image
+ */
+void MTCNN::roi_pyramid(const std::vector<cv::Rect>& regions, std::vector<cv::Rect>& sources, std::vector<cv::Size>& sizes)
+{
+    cv::Rect whole(0, 0, img_size_.width, img_size_.height);
+
+    sources.clear();
+    sizes.clear();
+
+    for(auto &region : regions)
+    {
+        int side = std::max(region.width, region.height);
+        int padding = side * roi_padding_;
+        cv::Rect source = cv::Rect(region.x - padding, region.y - padding,
+                                   region.width + 2 * padding, region.height + 2 * padding) & whole;
+        if(side <= 0 || source.width < 12 || source.height < 12)
+            continue;
+
+        double scale = 12. / (side * roi_face_range_[0]);
+        double last_scale = 12. / (side * roi_face_range_[1]);
+
+        for(; scale >= last_scale; scale *= factor_)
+        {
+            int resized_h = std::ceil(source.height*scale);
+            int resized_w = std::ceil(source.width*scale);
+            if(std::min(resized_h, resized_w) < 12)
+                break;
+
+            sources.push_back(source);
+            sizes.push_back(cv::Size(resized_w, resized_h));
+        }
+    }
+}
+
+/*
+ * pack_img() function
+ * used to place all the scales of the image pyramid in one canvas by shelves, the largest scale sets the width.
+ * Every scale starts at an even position and is followed by a gutter, so the cells of P-Net in a scale are at
+ * the same places as the forward of this scale alone, and a cell never sees two scales. The results are close to
+ * the forward of every scale alone but not the same: for a scale of odd width or height, the last window of the
+ * pooling of the scale alone is clipped at the edge, in the canvas it reads the gutter, which is mid-gray, so the
+ * last row or column of the cells may differ.
+ */
+void MTCNN::pack_img()
+{
+    std::vector<cv::Size> sizes = pyramid_sizes();
+    std::vector<cv::Rect> sources(sizes.size(), cv::Rect(0, 0, img_size_.width, img_size_.height));
+
+    pack_img(sources, sizes);
 }
 
-void MTCNN::GenerateBoxs(cv::Mat img)
+/*
+ * pack_img(const std::vector<cv::Rect>& sources, const std::vector<cv::Size>& sizes) function
+ * used to place the crops of the image at the given sizes in one canvas, the k-th crop is sources[k] of the image
+ * resized to sizes[k]. The widest crop sets the width of the canvas. Only the places are computed, the crops
+ * are written into the input of P-Net by Predict()
+ */
+void MTCNN::pack_img(const std::vector<cv::Rect>& sources, const std::vector<cv::Size>& sizes)
+{
+    int gutter = pack_gutter_ + (pack_gutter_ & 1);
+
+    pack_rects_.clear();
+    pack_sources_.clear();
+    if(sizes.empty())
+    {
+        pack_size_ = cv::Size(0, 0);
+        return;
+    }
+
+    //the x of the next free place and the top and height of every shelf
+    int max_w = 0;
+    for(auto &size : sizes)
+        max_w = std::max(max_w, size.width);
+    int canvas_w = (max_w + gutter + 1) / 2 * 2;
+    std::vector<int> shelf_x, shelf_y, shelf_h;
+    int canvas_h = 0;
+
+    for(auto &size : sizes)
+    {
+        int shelf = 0;
+        while(shelf < shelf_x.size() && (shelf_x[shelf] + size.width + gutter > canvas_w || size.height > shelf_h[shelf]))
+            shelf++;
+
+        if(shelf == shelf_x.size())
+        {
+            shelf_x.push_back(0);
+            shelf_y.push_back(canvas_h);
+            shelf_h.push_back(size.height);
+            canvas_h += (size.height + gutter + 1) / 2 * 2;
+        }
+
+        pack_rects_.push_back(cv::Rect(cv::Point(shelf_x[shelf], shelf_y[shelf]), size));
+        shelf_x[shelf] += (size.width + gutter + 1) / 2 * 2;
+    }
+
+    //the gutters are zero after the normalization, which is a mid-gray pixel
+    pack_size_ = cv::Size(canvas_w, canvas_h);
+    pack_sources_ = sources;
+}
+
+/*
+ * GenerateBoxs(const cv::Rect& placement, const cv::Rect& source, int feature_map_w) function
+ * used to generate the boxes of the cells of one scale, which is placed at placement of the input of P-Net
+ * and the feature map of the input has feature_map_w cells in a row. The scale is the region source of the
+ * image resized to the size of placement
+ */
+void MTCNN::GenerateBoxs(const cv::Rect& placement, const cv::Rect& source, int feature_map_w)
+{
+    std::vector<cv::Rect> bounding_box;
+    std::vector<float> confidence;
+
+    GenerateBoxs(placement, source, feature_map_w, regression_box_temp_, confidence_temp_, bounding_box, confidence);
+
+    //the cells of one scale overlap a lot, so they are suppressed before the scales are merged
+    nms_.apply(bounding_box, confidence, nullptr, threshold_NMS_, NMS::NEVER, 0.96);
+
+    confidence_.insert(confidence_.end(), confidence.begin(), confidence.end());
+    bounding_box_.insert(bounding_box_.end(), bounding_box.begin(), bounding_box.end());
+}
+
+/*
+ * GenerateBoxs(..., bounding_box, confidence) function
+ * used to generate the regressed boxes of one scale from the given outputs of P-Net into the given vectors,
+ * nothing of the members is written
+ */
+void MTCNN::GenerateBoxs(const cv::Rect& placement, const cv::Rect& source, int feature_map_w,
+                         const std::vector<float>& regression_map, const std::vector<float>& confidence_map,
+                         std::vector<cv::Rect>& bounding_box, std::vector<float>& confidence)
 {
     int stride = 2;
     int cellSize = input_geometry_[0].width;
-    int image_h = img.rows;
-    int image_w = img.cols;
-    double scale = double(image_w) / img_.cols ;
+    int image_h = placement.height;
+    int image_w = placement.width;
+    double scale = double(image_w) / source.width ;
     int feature_map_h = std::ceil((image_h - cellSize)*1.0/stride)+1;
-    int feature_map_w = std::ceil((image_w - cellSize)*1.0/stride)+1;
+    int feature_map_cols = std::ceil((image_w - cellSize)*1.0/stride)+1;
     int width = (cellSize) / scale;
-    int count = confidence_temp_.size();
+    int count = confidence_map.size();
     float thresh = threshold_[0];
 
-    std::vector<cv::Rect> bounding_box;
+    //the first cell of the scale in the feature map
+    int offset = placement.y / stride * feature_map_w + placement.x / stride;
+
     std::vector<cv::Rect> regression_box;
 //    cv::Rect regression_box;
-    std::vector<float> confidence;
+    bounding_box.clear();
+    confidence.clear();
 
-    for(int i = 0; i < count; i++)
+    for(int j = 0; j < feature_map_h * feature_map_cols; j++)
     {
-        if(confidence_temp_[i] < thresh)
-            continue;
+        int y = j / feature_map_cols;
+        int x = j - feature_map_cols * y;
 
-        confidence.push_back(confidence_temp_[i]);
+        int i = offset + y * feature_map_w + x;
+        if(i >= count || confidence_map[i] < thresh)
+            continue;
 
-        int y = i / feature_map_w;
-        int x = i - feature_map_w * y;
+        confidence.push_back(confidence_map[i]);
 
         //the regression box from the neural network
         //regression box : y x height width
-        regression_box.push_back(cv::Rect(regression_box_temp_[i + count] * width, regression_box_temp_[i] * width,
-                                          regression_box_temp_[i + count*3] * width, regression_box_temp_[i + count*2] * width));
+        regression_box.push_back(cv::Rect(regression_map[i + count] * width, regression_map[i] * width,
+                                          regression_map[i + count*3] * width, regression_map[i + count*2] * width));
 //        regression_box = cv::Rect(regression_box_temp_[i] * width, regression_box_temp_[i + count] * width,
 //                                          regression_box_temp_[i + count*2] * width, regression_box_temp_[i + count*3] * width));
         //the bounding box combined with regression box
-        bounding_box.push_back(cv::Rect((x*stride+1)/scale, (y*stride+1)/scale,
+        bounding_box.push_back(cv::Rect((x*stride+1)/scale + source.x, (y*stride+1)/scale + source.y,
                                         width, width));
 
         if((x*stride+1)/scale < -1000 || (x*stride+1)/scale > 1000)
@@ -591,9 +1057,7 @@ void MTCNN::GenerateBoxs(cv::Mat img)
 
     }
 
-    confidence_.insert(confidence_.end(), confidence.begin(), confidence.end());
     BoxRegress(bounding_box, regression_box);
-    bounding_box_.insert(bounding_box_.end(), bounding_box.begin(), bounding_box.end());
 //    regression_box_.insert(regression_box_.end(), regression_box.begin(), regression_box.end());
 }
 
@@ -628,65 +1092,138 @@ void MTCNN::Padding(std::vector<cv::Rect>& bounding_box, int img_w,int img_h)
     }
 }
 
-cv::Mat MTCNN::crop(cv::Mat img, cv::Rect& rect)
-{
-    cv::Rect rect_old = rect;
+namespace {
 
-//    if(rect.width > rect.height)
-//    {
-//        int change_to_square = rect.width - rect.height;
-//        rect.height += change_to_square;
-//        rect.y -= change_to_square * 0.5;
-//    }
-//    else
-//    {
-//        int change_to_square = rect.height - rect.width;
-//        rect.width += change_to_square;
-//        rect.x -= change_to_square * 0.5;
-//    }
+//the taps and the line of fill_input(), kept by every thread so a crop does not allocate them
+thread_local std::vector<int> row_offset, row_index, col_offset, col_index;
+thread_local std::vector<float> row_weight, col_weight, line;
 
-    cv::Rect padding;
+/*
+ * resize_taps() function
+ * used to get the pixels of the source and their weights for every pixel of a resized axis, the length pixels
+ * from start are resized to size pixels. The shrinking averages the covered pixels as INTER_AREA if area is set,
+ * otherwise it is linear as the growing, as INTER_LINEAR. The pixels out of [0, limit) are black, so they are
+ * left out of the taps
+ */
+void resize_taps(double start, double length, int size, int limit, bool area,
+                 std::vector<int>& offset, std::vector<int>& index, std::vector<float>& weight)
+{
+    double scale = double(length) / size;
 
-    if(rect.x < 0)
-    {
-        padding.x = -rect.x;
-        rect.x = 0;
-    }
-    if(rect.y < 0)
-    {
-        padding.y = -rect.y;
-        rect.y = 0;
-    }
-    if(img.cols < (rect.x + rect.width))
-    {
-        padding.width = rect.x + rect.width - img.cols;
-        rect.width = img.cols-rect.x;
-    }
-    if(img.rows < (rect.y + rect.height))
-    {
-        padding.height = rect.y + rect.height - img.rows;
-        rect.height = img.rows - rect.y;
-    }
-    if(rect.width<0 || rect.height<0)
+    offset.assign(1, 0);
+    index.clear();
+    weight.clear();
+
+    for(int k = 0; k < size; k++)
     {
-        rect = cv::Rect(0,0,0,0);
-        padding = cv::Rect(0,0,0,0);
+        if(area && scale > 1)
+        {
+            double from = start + k * scale;
+            double to = from + scale;
+            for(int i = std::floor(from); i < to; i++)
+            {
+                double w = (std::min(to, i + 1.) - std::max(from, double(i))) / scale;
+                if(w > 0 && i >= 0 && i < limit)
+                {
+                    index.push_back(i);
+                    weight.push_back(w);
+                }
+            }
+        }
+        else
+        {
+            double last = std::max(start, start + length - 1);
+            double center = std::min(std::max(start + (k + 0.5) * scale - 0.5, start), last);
+            int i0 = std::floor(center);
+            int i1 = std::min(i0 + 1, int(std::floor(last)));
+            float f = center - i0;
+            if(i0 >= 0 && i0 < limit)
+            {
+                index.push_back(i0);
+                weight.push_back(1 - f);
+            }
+            if(f > 0 && i1 >= 0 && i1 < limit)
+            {
+                index.push_back(i1);
+                weight.push_back(f);
+            }
+        }
+        offset.push_back(index.size());
     }
-    cv::Mat img_cropped = img(rect);
-    if(padding.x||padding.y||padding.width||padding.height)
+}
+
+}
+
+/*
+ * fill_input() function
+ * used to write the region source of the image of the nets, resized to placement, into the planes of an input
+ * of input_size. The frame is read once, the resize, the normalization, the RGB order and the transposition
+ * of the transposed nets are done in the same pass. The pixels out of the frame are black, as the padding
+ * of the crops. The scales of P-Net are shrunk by the area as cv::INTER_AREA, the crops of R-Net and O-Net
+ * (area is false) are sampled from the frame itself as cv::INTER_LINEAR, the same inputs as cv::resize gives
+ * within the rounding
+ */
+void MTCNN::fill_input(const cv::Rect& source, const cv::Rect& placement, float* input, const cv::Size& input_size,
+                       bool area)
+{
+    //the axis of the image of the nets along the rows of the frame, which is y for the row-major nets and x
+    //for the transposed nets, and the step of the input along it
+    int row_start = row_major_ ? source.y : source.x;
+    int row_length = row_major_ ? source.height : source.width;
+    int row_size = row_major_ ? placement.height : placement.width;
+    int col_start = row_major_ ? source.x : source.y;
+    int col_length = row_major_ ? source.width : source.height;
+    int col_size = row_major_ ? placement.width : placement.height;
+    int row_step = row_major_ ? input_size.width : 1;
+    int col_step = row_major_ ? 1 : input_size.width;
+
+    //the deepest octave which has a pixel for every pixel of the input on both axes
+    int level = 0;
+    if(area && cascade_pyramid_ && row_size > 0 && col_size > 0)
+        level = pyramid_->level_for(std::min(double(row_length) / row_size, double(col_length) / col_size));
+    const cv::Mat& frame = pyramid_->level(level);
+    double octave = 1 << level;
+
+    resize_taps(row_start / octave, row_length / octave, row_size, frame.rows, area, row_offset, row_index, row_weight);
+    resize_taps(col_start / octave, col_length / octave, col_size, frame.cols, area, col_offset, col_index, col_weight);
+
+    int channels = frame.channels();
+    int plane = input_size.area();
+    int col_begin = col_index.empty() ? 0 : *std::min_element(col_index.begin(), col_index.end());
+    int col_end = col_index.empty() ? 0 : *std::max_element(col_index.begin(), col_index.end()) + 1;
+
+    //the rows of the frame of one output row, weighted and summed, in the order of the frame
+    line.resize((col_end - col_begin) * channels);
+
+    float* origin = input + placement.y * input_size.width + placement.x;
+    for(int r = 0; r < row_size; r++)
     {
-        cv::copyMakeBorder(img_cropped, img_cropped, padding.y, padding.height, padding.x, padding.width,cv::BORDER_CONSTANT,cv::Scalar(0));
-        //here, the rect should be changed
-        rect.x -= padding.x;
-        rect.y -= padding.y;
-        rect.width += padding.width + padding.x;
-        rect.width += padding.height + padding.y;
-    }
+        std::fill(line.begin(), line.end(), 0.f);
+        for(int t = row_offset[r]; t < row_offset[r + 1]; t++)
+        {
+            const uchar* pixel = frame.ptr<uchar>(row_index[t]) + col_begin * channels;
+            float w = row_weight[t];
+            for(int c = 0; c < line.size(); c++)
+                line[c] += w * pixel[c];
+        }
 
-//    cv::imshow("crop", img_cropped);
-//    cv::waitKey(0);
+        float* output = origin + r * row_step;
+        for(int q = 0; q < col_size; q++)
+        {
+            float sum[3] = {0, 0, 0};
+            for(int t = col_offset[q]; t < col_offset[q + 1]; t++)
+            {
+                const float* pixel = &line[(col_index[t] - col_begin) * channels];
+                float w = col_weight[t];
+                for(int c = 0; c < channels; c++)
+                    sum[c] += w * pixel[c];
+            }
 
-    return img_cropped;
+            //the frame is in BGR order and the nets are in RGB order
+            for(int c = 0; c < channels; c++)
+                output[(channels - 1 - c) * plane + q * col_step] = sum[c] * 0.0078125f - 127.5f * 0.0078125f;
+        }
+    }
 }
 
 void MTCNN::img_show(cv::Mat img, std::string name)
@@ -715,6 +1252,11 @@ void MTCNN::img_show(cv::Mat img, std::string name)
     //cv::waitKey(0);
 }
 
+/*
+ * img_show_T() function
+ * used to draw the candidates of now on the frame, they are in the image of the nets, which is the transposed
+ * frame unless the nets are row-major
+ */
 void MTCNN::img_show_T(cv::Mat img, std::string name)
 {
     cv::Mat img_show;
@@ -724,8 +1266,9 @@ void MTCNN::img_show_T(cv::Mat img, std::string name)
 
     for(int i = 0; i < bounding_box_.size(); i++)
     {
-        rectangle(img_show, cv::Rect(bounding_box_[i].y, bounding_box_[i].x, bounding_box_[i].height, bounding_box_[i].width), cv::Scalar(0, 0, 255), 3);
-        cv::putText(img_show, std::to_string(confidence_[i]), cvPoint(bounding_box_[i].y + 3, bounding_box_[i].x + 13),
+        cv::Rect box = to_frame(bounding_box_[i]);
+        rectangle(img_show, box, cv::Scalar(0, 0, 255), 3);
+        cv::putText(img_show, std::to_string(confidence_[i]), cvPoint(box.x + 3, box.y + 13),
                     cv::FONT_HERSHEY_COMPLEX_SMALL, 0.8, cvScalar(0, 0, 255), 1, CV_AA);
     }
 
@@ -733,7 +1276,8 @@ void MTCNN::img_show_T(cv::Mat img, std::string name)
     {
         for(int j = 0; j < alignment_[i].size(); j++)
         {
-            cv::circle(img_show, cv::Point(alignment_[i][j].y, alignment_[i][j].x), 5, cv::Scalar(255, 255, 0), 3);
+            cv::Point point = row_major_ ? alignment_[i][j] : cv::Point(alignment_[i][j].y, alignment_[i][j].x);
+            cv::circle(img_show, point, 5, cv::Scalar(255, 255, 0), 3);
         }
     }
 
@@ -7,12 +7,16 @@
 #ifndef MTCNN_MTCNN_H
 #define MTCNN_MTCNN_H
 
-#include <caffe/caffe.hpp>
 #include <opencv2/opencv.hpp>
+#include <atomic>
+#include <map>
 #include <string>
+#include <thread>
 #include <vector>
-
-using namespace caffe;
+#include "Backend.h"
+#include "FramePyramid.h"
+#include "MTCNNModel.h"
+#include "NMS.h"
 
 class MTCNN {
 
@@ -20,15 +24,29 @@ public:
 
     MTCNN();
     MTCNN(const std::vector<std::string> model_file, const std::vector<std::string> trained_file);
+    MTCNN(std::shared_ptr<const MTCNNModel> model);
     ~MTCNN();
 
     void detection(const cv::Mat& img, std::vector<cv::Rect>& rectangles);
     void detection(const cv::Mat& img, std::vector<cv::Rect>& rectangles, std::vector<float>& confidence);
     void detection(const cv::Mat& img, std::vector<cv::Rect>& rectangles, std::vector<float>& confidence, std::vector<std::vector<cv::Point>>& alignment);
     void detection_TEST(const cv::Mat& img, std::vector<cv::Rect>& rectangles);
+    void detection_ROI(const cv::Mat& img, const std::vector<cv::Rect>& regions, std::vector<cv::Rect>& rectangles);
+    void detection_ROI(const cv::Mat& img, const std::vector<cv::Rect>& regions, std::vector<cv::Rect>& rectangles, std::vector<float>& confidence);
 
     void Preprocess(const cv::Mat &img);
+    void use_pyramid(std::shared_ptr<const FramePyramid> pyramid);
+    cv::Rect to_frame(const cv::Rect& rect);
     void P_Net();
+    void P_Net_parallel();
+    void P_Net_ROI(const std::vector<cv::Rect>& regions);
+    void set_P_Net_workers(int workers);
+    void set_pack_scales(bool pack);
+    Net<float>* plan_P_Net(const cv::Size& input_size);
+    Net<float>* plan_batch(int i, int count);
+    Net<float>* stage(int i);
+    void warm_up(const cv::Size& frame_size);
+    static bool quantize(std::shared_ptr<MTCNNModel> model, const std::vector<cv::Mat>& frames);
     void R_Net();
     void O_Net();
     void detect_net(int i);
@@ -38,29 +56,69 @@ public:
 
     void Predict(const cv::Mat& img, int i);
     void Predict(const std::vector<cv::Mat> imgs, int i);
+    void Predict(const std::vector<cv::Rect>& boxes, int i);
+    void Predict(Net<float>* net, const cv::Mat& img, std::vector<float>& regression_box, std::vector<float>& confidence_map);
+    void Predict(Net<float>* net, const std::vector<cv::Rect>& sources, const std::vector<cv::Rect>& placements,
+                 const cv::Size& input_size, std::vector<float>& regression_box, std::vector<float>& confidence_map);
+    void ReadOutput(Net<float>* net, int i, int count);
+    void fill_input(const cv::Rect& source, const cv::Rect& placement, float* input, const cv::Size& input_size,
+                    bool area = true);
     void WrapInputLayer(const cv::Mat& img, std::vector<cv::Mat> *input_channels, int i);
+    void WrapInputLayer(Net<float>* net, const cv::Mat& img, std::vector<cv::Mat> *input_channels);
     void WrapInputLayer(const vector<cv::Mat> imgs, std::vector<cv::Mat> *input_channels, int i);
 
     float IoU(cv::Rect rect1, cv::Rect rect2);
     float IoM(cv::Rect rect1, cv::Rect rect2);
-    void resize_img();
-    void GenerateBoxs(cv::Mat img);
+    std::vector<cv::Size> pyramid_sizes();
+    void roi_pyramid(const std::vector<cv::Rect>& regions, std::vector<cv::Rect>& sources, std::vector<cv::Size>& sizes);
+    void pack_img();
+    void pack_img(const std::vector<cv::Rect>& sources, const std::vector<cv::Size>& sizes);
+    void GenerateBoxs(const cv::Rect& placement, const cv::Rect& source, int feature_map_w);
+    void GenerateBoxs(const cv::Rect& placement, const cv::Rect& source, int feature_map_w,
+                      const std::vector<float>& regression_map, const std::vector<float>& confidence_map,
+                      std::vector<cv::Rect>& bounding_box, std::vector<float>& confidence);
     void BoxRegress(std::vector<cv::Rect>& bounding_box, std::vector<cv::Rect> regression_box);
     void Padding(std::vector<cv::Rect>& bounding_box, int img_w,int img_h);
-    cv::Mat crop(cv::Mat img, cv::Rect& rect);
 
     void img_show(cv::Mat img, std::string name);
     void img_show_T(cv::Mat img, std::string name);
-    //param for P, R, O, L net
+    //param for P, R, O, L net, the nets are the replicas of the model
+    std::shared_ptr<const MTCNNModel> model_;
     std::vector<std::shared_ptr<Net<float>>> nets_;
     std::vector<cv::Size> input_geometry_;
     int num_channels_;
+    std::vector<std::string> model_file_;
+    bool row_major_;
+
+    //the number of workers of the parallel scales of P-Net, see set_P_Net_workers()
+    int p_net_workers_ = 1;
+
+    //the replicas reshaped once for an input size of P-Net, and the replica of R-Net and O-Net which is sized to the
+    //largest bucket of the batch and reshaped to the bucket of every batch
+    std::map<std::pair<int, int>, std::shared_ptr<Net<float>>> p_net_plans_;
+    std::vector<std::shared_ptr<Net<float>>> batch_nets_;
 
-    //variable for the image
-    cv::Mat img_;
-    std::vector<cv::Mat> img_resized_;
+    //variable for the image, the frame in BGR order and the size of the image of the nets, which is the
+    //transposed frame unless the nets are row-major
+    cv::Mat frame_;
+    cv::Size img_size_;
+
+    //the octaves of the frame, the ones of the caller are used for the next frame if they are built on it
+    std::shared_ptr<const FramePyramid> pyramid_;
+    std::shared_ptr<const FramePyramid> next_pyramid_;
     std::vector<double> scale_;
 
+    //the scales of the last size of the image and the parameters of them
+    cv::Size planned_size_;
+    int planned_minSize_ = 0;
+    float planned_factor_ = 0;
+    std::vector<cv::Size> planned_sizes_;
+
+    //variable for the packed scales, all the scales of the pyramid are placed in one canvas
+    cv::Size pack_size_;
+    std::vector<cv::Rect> pack_rects_;
+    std::vector<cv::Rect> pack_sources_;
+
     //variable for the output of the neural network
 //    std::vector<cv::Rect> regression_box_;
     std::vector<float> regression_box_temp_;
@@ -70,11 +128,30 @@ public:
     std::vector<std::vector<cv::Point>> alignment_;
     std::vector<float> alignment_temp_;
 
+    //the buffers of the suppression of the candidates
+    NMS nms_;
+
     //paramter for the threshold
     int minSize_ = 200;
     float factor_ = 0.709;
     float threshold_[3] = {0.5, 0.5, 0.3};
     float threshold_NMS_ = 0.5;
+
+    //paramter for the P-Net, the packing mode of set_pack_scales(), the gutter between the packed scales should be
+    //even to keep the stride
+    bool pack_scales_ = false;
+
+    //paramter for the input, a scale is resized from the nearest octave of the frame instead of the frame
+    bool cascade_pyramid_ = true;
+
+    //paramter for the R-Net and O-Net, the largest bucket of the batch, more boxes are forwarded in several batches
+    int max_batch_ = 32;
+    int pack_gutter_ = 2;
+
+    //paramter for the ROI detection, the region is padded by a part of its size on every side and searched for
+    //the faces from roi_face_range_[0] to roi_face_range_[1] times of its size
+    float roi_padding_ = 0.5;
+    float roi_face_range_[2] = {0.5, 1.5};
 };
 
 
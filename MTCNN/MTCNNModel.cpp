@@ -0,0 +1,296 @@
+//
+// The immutable part of MTCNN, which is shared by all the detectors
+//
+
+#include "MTCNNModel.h"
+#include <algorithm>
+#include <stdexcept>
+
+MTCNNModel::MTCNNModel(bool row_major)
+        : MTCNNModel({"./MTCNN/model/det1.prototxt",
+                      "./MTCNN/model/det2.prototxt",
+                      "./MTCNN/model/det3.prototxt"},
+                     {"./MTCNN/model/det1.caffemodel",
+                      "./MTCNN/model/det2.caffemodel",
+                      "./MTCNN/model/det3.caffemodel"},
+                     row_major)
+{
+}
+
+MTCNNModel::MTCNNModel(const std::vector<std::string> model_file, const std::vector<std::string> trained_file,
+                       bool row_major)
+{
+    #ifdef CPU_ONLY
+        Caffe::set_mode(Caffe::CPU);
+    #else
+        Caffe::set_mode(Caffe::GPU);
+    #endif
+
+    model_file_ = model_file;
+    trained_file_ = trained_file;
+    row_major_ = row_major;
+
+    nets_.resize(model_file.size());
+    input_geometry_.resize(model_file.size());
+    load_times_.assign(model_file.size(), 0);
+
+    //every net is loaded in its own thread, the nets after P-Net check their channels against it
+    std::shared_future<void> p_net;
+    for(int i = 0; i < model_file.size(); i++)
+    {
+        loading_.push_back(std::async(std::launch::async, [this, i, p_net]()
+        {
+            //the mode of caffe is kept per thread
+            #ifdef CPU_ONLY
+                Caffe::set_mode(Caffe::CPU);
+            #else
+                Caffe::set_mode(Caffe::GPU);
+            #endif
+
+            double start = (double)cv::getTickCount();
+            std::shared_ptr<Net<float>> net;
+            net.reset(new Net<float>(model_file_[i], TEST));
+            net->CopyTrainedLayersFrom(trained_file_[i]);
+            if(row_major_)
+                to_row_major(net.get());
+
+            if(p_net.valid())
+                p_net.wait();
+            add(i, net);
+            load_times_[i] = ((double)cv::getTickCount() - start) / cv::getTickFrequency() * 1000;
+        }).share());
+
+        if(i == 0)
+            p_net = loading_[0];
+    }
+
+    //the threads use the members, so all of them are finished before a failure of P-Net is thrown
+    try
+    {
+        if(!loading_.empty())
+            wait(0);
+    }
+    catch(...)
+    {
+        for(auto& loading : loading_)
+            loading.wait();
+        throw;
+    }
+}
+
+/*
+ * the nets of the packed file of save(), the file is mapped and the weights are not copied, so the models of all
+ * the processes on the same file share one copy of the weights. A file which can not be loaded throws
+ * std::runtime_error, as the build without LiteNet does
+ */
+MTCNNModel::MTCNNModel(const std::string& packed_file)
+{
+#ifdef USE_LITENET
+    double start = (double)cv::getTickCount();
+    uint32_t flags = 0;
+    std::vector<std::shared_ptr<Net<float>>> nets = Net<float>::LoadPacked(packed_file, &flags);
+    double load_time = ((double)cv::getTickCount() - start) / cv::getTickFrequency() * 1000;
+    if(nets.empty())
+        throw std::runtime_error("Can not load the packed model " + packed_file);
+
+    nets_.resize(nets.size());
+    input_geometry_.resize(nets.size());
+    for(int i = 0; i < nets.size(); i++)
+        add(i, nets[i]);
+
+    //the nets of the file are mapped together, every one is given the whole time
+    load_times_.assign(nets.size(), load_time);
+    row_major_ = flags & 1;
+#else
+    throw std::runtime_error("The packed model needs LiteNet, build with USE_LITENET");
+#endif
+}
+
+//the threads of the nets use the members of the model
+MTCNNModel::~MTCNNModel()
+{
+    for(auto& loading : loading_)
+        loading.wait();
+}
+
+void MTCNNModel::add(int i, std::shared_ptr<Net<float>> net)
+{
+    Blob<float>* input_layer = net->input_blobs()[0];
+    int num_channel = input_layer->channels();
+
+    if(i == 0)
+        num_channels_ = num_channel;
+    else if(num_channels_ != num_channel)
+        std::cout << "Error: The number channels of the nets are different!" << std::endl;
+    nets_[i] = net;
+    input_geometry_[i] = cv::Size(input_layer->width(), input_layer->height());
+}
+
+//the exception of a thread which failed to load its net is thrown again to every caller
+void MTCNNModel::wait(int i) const
+{
+    if(i < loading_.size())
+        loading_[i].get();
+}
+
+void MTCNNModel::wait_all() const
+{
+    for(int i = 0; i < loading_.size(); i++)
+        loading_[i].get();
+}
+
+std::vector<double> MTCNNModel::load_times() const
+{
+    wait_all();
+    return load_times_;
+}
+
+bool MTCNNModel::save(const std::string& packed_file) const
+{
+#ifdef USE_LITENET
+    wait_all();
+    std::vector<Net<float>*> nets;
+    for(auto& net : nets_)
+        nets.push_back(net.get());
+    return Net<float>::SavePacked(packed_file, nets, row_major_ ? 1 : 0);
+#else
+    std::cout << "Error: The packed model needs LiteNet, build with USE_LITENET!" << std::endl;
+    return false;
+#endif
+}
+
+std::shared_ptr<Net<float>> MTCNNModel::replicate(int i) const
+{
+    wait(i);
+#ifdef USE_LITENET
+    //the prototxt is kept by the net, which may be loaded from a packed file
+    return nets_[i]->Replicate();
+#else
+    std::shared_ptr<Net<float>> net;
+    net.reset(new Net<float>(model_file_[i], TEST));
+    net->ShareTrainedLayersWith(nets_[i].get());
+    return net;
+#endif
+}
+
+/*
+ * calibrate() function
+ * used to start or stop recording the range of the inputs of the layers of R and O net. The range is kept with the
+ * weights, so the detections of all the detectors on this model are recorded
+ */
+void MTCNNModel::calibrate(bool on)
+{
+#ifdef USE_LITENET
+    wait_all();
+    for(int i = 1; i < nets_.size(); i++)
+        nets_[i]->Calibrate(on);
+#else
+    std::cout << "Error: The int8 nets need LiteNet, build with USE_LITENET!" << std::endl;
+#endif
+}
+
+/*
+ * quantize() function
+ * used to change R and O net to int8 with the range recorded by calibrate(), the detectors on this model are
+ * changed too. A layer without a range is kept in float and false is returned
+ */
+bool MTCNNModel::quantize()
+{
+#ifdef USE_LITENET
+    wait_all();
+    bool all = true;
+    for(int i = 1; i < nets_.size(); i++)
+        all = nets_[i]->Quantize() && all;
+    return all;
+#else
+    std::cout << "Error: The int8 nets need LiteNet, build with USE_LITENET!" << std::endl;
+    return false;
+#endif
+}
+
+namespace {
+
+//transpose every size * size block of the data in place
+void transpose_blocks(float* data, int blocks, int size)
+{
+    for(int b = 0; b < blocks; b++, data += size * size)
+    {
+        for(int y = 0; y < size; y++)
+            for(int x = y + 1; x < size; x++)
+                std::swap(data[y * size + x], data[x * size + y]);
+    }
+}
+
+}
+
+/*
+ * to_row_major() function
+ * used to change the weights of a net trained on the transposed images, as the MATLAB images of MTCNN, to the
+ * same net on the images as they are. The kernels of the convolutions are transposed, so the feature maps are
+ * the transposed maps of before, the inputs of an inner product on a feature map are reordered to match, and
+ * the outputs of the boxes and the landmarks are swapped between x and y. The kernels and the feature maps
+ * should be square, as the ones of MTCNN
+ */
+void MTCNNModel::to_row_major(Net<float>* net)
+{
+    const auto& layers = net->layers();
+    const auto& outputs = net->output_blobs();
+
+    for(int l = 0; l < layers.size(); l++)
+    {
+        std::string type = layers[l]->type();
+        auto& blobs = layers[l]->blobs();
+        if(blobs.empty())
+            continue;
+
+        Blob<float>* weight = blobs[0].get();
+
+        if(type == "Convolution")
+        {
+            int kernel = weight->shape(2);
+            if(kernel != weight->shape(3))
+            {
+                std::cout << "Error: The kernel of " << layers[l]->layer_param().name() << " is not square!" << std::endl;
+                continue;
+            }
+            transpose_blocks(weight->mutable_cpu_data(), weight->count() / (kernel * kernel), kernel);
+        }
+        else if(type == "InnerProduct")
+        {
+            Blob<float>* bottom = net->bottom_vecs()[l][0];
+            if(bottom->num_axes() == 4 && bottom->height() * bottom->width() > 1)
+            {
+                if(bottom->height() != bottom->width())
+                {
+                    std::cout << "Error: The input of " << layers[l]->layer_param().name() << " is not square!" << std::endl;
+                    continue;
+                }
+                //every row of the weight is channels * height * width
+                transpose_blocks(weight->mutable_cpu_data(), weight->count() / (bottom->height() * bottom->width()), bottom->height());
+            }
+        }
+
+        //the boxes are y, x, height, width and the landmarks are 5 y and 5 x of the transposed image
+        Blob<float>* top = net->top_vecs()[l][0];
+        if(std::find(outputs.begin(), outputs.end(), top) == outputs.end())
+            continue;
+
+        int out = weight->shape(0);
+        std::vector<int> order;
+        if(out == 4)
+            order = {1, 0, 3, 2};
+        else if(out == 10)
+            order = {5, 6, 7, 8, 9, 0, 1, 2, 3, 4};
+        else
+            continue;
+
+        for(auto &blob : blobs)
+        {
+            int row = blob->count() / out;
+            std::vector<float> old(blob->cpu_data(), blob->cpu_data() + blob->count());
+            float* data = blob->mutable_cpu_data();
+            for(int o = 0; o < out; o++)
+                std::copy(old.begin() + order[o] * row, old.begin() + (order[o] + 1) * row, data + o * row);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+//
+// The immutable part of MTCNN, which is shared by all the detectors
+//
+
+#define CPU_ONLY
+
+#ifndef MTCNN_MTCNNMODEL_H
+#define MTCNN_MTCNNMODEL_H
+
+#include <opencv2/opencv.hpp>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Backend.h"
+
+/*
+ * MTCNNModel keeps the weights of P, R and O net, which are loaded once and never written afterwards.
+ * A detector never forwards these nets, it forwards its own replicas which share the weights, so the
+ * model could be used by many detectors and threads at the same time.
+ *
+ * The nets of the caffe models are loaded at the same time in their own threads, the constructor returns when
+ * P-Net is loaded and R-Net and O-Net are waited for when they are first used, see wait().
+ */
+class MTCNNModel {
+
+public:
+
+    MTCNNModel(bool row_major = true);
+    MTCNNModel(const std::vector<std::string> model_file, const std::vector<std::string> trained_file,
+               bool row_major = true);
+    MTCNNModel(const std::string& packed_file);
+    MTCNNModel(const char* packed_file) : MTCNNModel(std::string(packed_file)) {}
+    ~MTCNNModel();
+
+    //write the nets, as they are now, to the packed file of LiteNet, which is mapped by MTCNNModel(packed_file)
+    bool save(const std::string& packed_file) const;
+
+    //create a new instance of the i-th net, the blobs are its own and the weights are shared with the model
+    std::shared_ptr<Net<float>> replicate(int i) const;
+
+    int size() const { return nets_.size(); }
+
+    //wait for the i-th net to be loaded, its members below are set afterwards, the error of its loading is thrown
+    void wait(int i) const;
+    cv::Size input_geometry(int i) const { wait(i); return input_geometry_[i]; }
+
+    //the time to load every net in ms, after waiting for all of them
+    std::vector<double> load_times() const;
+
+    //change the weights of a net trained on the transposed images to take the images as they are
+    static void to_row_major(Net<float>* net);
+
+    //record the range of the inputs of R and O net in the detections, then change them to int8, see MTCNN::quantize()
+    void calibrate(bool on);
+    bool quantize();
+
+    //param for P, R, O, L net
+    std::vector<std::string> model_file_;
+    std::vector<std::string> trained_file_;
+    std::vector<std::shared_ptr<Net<float>>> nets_;
+    std::vector<cv::Size> input_geometry_;
+    int num_channels_ = 0;
+
+    //the nets take the images in row-major order, otherwise the images are transposed as the nets were trained
+    bool row_major_ = true;
+
+private:
+    void add(int i, std::shared_ptr<Net<float>> net);
+    void wait_all() const;
+
+    //the loading of every net, which is empty if the nets are loaded by the constructor
+    std::vector<std::shared_future<void>> loading_;
+    std::vector<double> load_times_;
+};
+
+
+#endif //MTCNN_MTCNNMODEL_H
@@ -0,0 +1,68 @@
+//
+// A pool of MTCNN workspaces on one shared model
+//
+
+#include "MTCNNPool.h"
+
+MTCNNPool::MTCNNPool(std::shared_ptr<const MTCNNModel> model)
+{
+    model_ = model;
+}
+
+MTCNNPool::~MTCNNPool(){}
+
+void MTCNNPool::detection(const cv::Mat& img, std::vector<cv::Rect>& rectangles)
+{
+    std::vector<float> confidence;
+    std::vector<std::vector<cv::Point>> alignment;
+    detection(img, rectangles, confidence, alignment);
+}
+
+void MTCNNPool::detection(const cv::Mat& img, std::vector<cv::Rect>& rectangles, std::vector<float>& confidence)
+{
+    std::vector<std::vector<cv::Point>> alignment;
+    detection(img, rectangles, confidence, alignment);
+}
+
+void MTCNNPool::detection(const cv::Mat& img, std::vector<cv::Rect>& rectangles, std::vector<float>& confidence, std::vector<std::vector<cv::Point>>& alignment)
+{
+    //the mode of caffe is kept per thread
+    #ifdef CPU_ONLY
+        Caffe::set_mode(Caffe::CPU);
+    #else
+        Caffe::set_mode(Caffe::GPU);
+    #endif
+
+    std::unique_ptr<MTCNN> workspace = acquire();
+    workspace->detection(img, rectangles, confidence, alignment);
+    release(std::move(workspace));
+}
+
+int MTCNNPool::workspaces()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return created_;
+}
+
+std::unique_ptr<MTCNN> MTCNNPool::acquire()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!idle_.empty())
+        {
+            std::unique_ptr<MTCNN> workspace = std::move(idle_.back());
+            idle_.pop_back();
+            return workspace;
+        }
+        created_++;
+    }
+
+    //the replicas are created out of the lock, the other threads keep going
+    return std::unique_ptr<MTCNN>(new MTCNN(model_));
+}
+
+void MTCNNPool::release(std::unique_ptr<MTCNN> workspace)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_.push_back(std::move(workspace));
+}
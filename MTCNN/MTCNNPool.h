@@ -0,0 +1,47 @@
+//
+// A pool of MTCNN workspaces on one shared model
+//
+
+#ifndef MTCNN_MTCNNPOOL_H
+#define MTCNN_MTCNNPOOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "MTCNN.h"
+
+/*
+ * MTCNNPool is used to detect faces from many threads against one loaded model. Every call takes an idle
+ * MTCNN from the pool, which holds the per-call state and the blobs of the forward, and returns it afterwards.
+ * A new MTCNN is created only when all of them are busy, so the pool grows to the number of concurrent calls
+ * and the weights are never copied.
+ */
+class MTCNNPool {
+
+public:
+
+    MTCNNPool(std::shared_ptr<const MTCNNModel> model);
+    ~MTCNNPool();
+
+    void detection(const cv::Mat& img, std::vector<cv::Rect>& rectangles);
+    void detection(const cv::Mat& img, std::vector<cv::Rect>& rectangles, std::vector<float>& confidence);
+    void detection(const cv::Mat& img, std::vector<cv::Rect>& rectangles, std::vector<float>& confidence, std::vector<std::vector<cv::Point>>& alignment);
+
+    //the number of MTCNN created by the pool
+    int workspaces();
+
+private:
+
+    std::unique_ptr<MTCNN> acquire();
+    void release(std::unique_ptr<MTCNN> workspace);
+
+    std::shared_ptr<const MTCNNModel> model_;
+
+    //the idle workspaces, guarded by the mutex
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<MTCNN>> idle_;
+    int created_ = 0;
+};
+
+
+#endif //MTCNN_MTCNNPOOL_H
@@ -0,0 +1,92 @@
+//
+// The non-maximum suppression of the candidate boxes of MTCNN
+//
+
+#include "NMS.h"
+#include <algorithm>
+#include <numeric>
+
+constexpr float NMS::NEVER;
+
+void NMS::apply(std::vector<cv::Rect>& bounding_box, std::vector<float>& confidence,
+                std::vector<std::vector<cv::Point>>* alignment,
+                float threshold_IoU, float threshold_IoM, float protect)
+{
+    int n = bounding_box.size();
+    if(n < 2)
+        return;
+
+    //sorted once, the first one of the same confidence is kept as before
+    order_.resize(n);
+    std::iota(order_.begin(), order_.end(), 0);
+    std::stable_sort(order_.begin(), order_.end(), [&](int a, int b){ return confidence[a] > confidence[b]; });
+
+    x1_.resize(n);
+    y1_.resize(n);
+    x2_.resize(n);
+    y2_.resize(n);
+    area_.resize(n);
+    movable_.resize(n);
+    suppressed_.assign(n, 0);
+
+    for(int k = 0; k < n; k++)
+    {
+        const cv::Rect& box = bounding_box[order_[k]];
+        float width = std::max(0, box.width);
+        float height = std::max(0, box.height);
+        x1_[k] = box.x;
+        y1_[k] = box.y;
+        x2_[k] = box.x + width;
+        y2_[k] = box.y + height;
+        area_[k] = width * height;
+        movable_[k] = confidence[order_[k]] < protect;
+    }
+
+    const float* x1 = x1_.data();
+    const float* y1 = y1_.data();
+    const float* x2 = x2_.data();
+    const float* y2 = y2_.data();
+    const float* area = area_.data();
+    const unsigned char* movable = movable_.data();
+    unsigned char* suppressed = suppressed_.data();
+
+    for(int i = 0; i < n; i++)
+    {
+        if(suppressed[i])
+            continue;
+
+        float ix1 = x1[i], iy1 = y1[i], ix2 = x2[i], iy2 = y2[i], iarea = area[i];
+
+        //the ratios are compared as products, so there is no division and no branch in the loop
+        for(int j = i + 1; j < n; j++)
+        {
+            float w = std::max(0.f, std::min(ix2, x2[j]) - std::max(ix1, x1[j]));
+            float h = std::max(0.f, std::min(iy2, y2[j]) - std::max(iy1, y1[j]));
+            float intersection = w * h;
+            float unions = iarea + area[j] - intersection;
+            float min_area = std::min(iarea, area[j]);
+            unsigned char overlap = (intersection > threshold_IoU * unions) | (intersection > threshold_IoM * min_area);
+            suppressed[j] |= overlap & movable[j];
+        }
+    }
+
+    bool has_alignment = alignment && alignment->size() == n;
+
+    std::vector<cv::Rect> kept_box;
+    std::vector<float> kept_confidence;
+    std::vector<std::vector<cv::Point>> kept_alignment;
+    for(int k = 0; k < n; k++)
+    {
+        if(suppressed[k])
+            continue;
+        kept_box.push_back(bounding_box[order_[k]]);
+        kept_confidence.push_back(confidence[order_[k]]);
+        if(has_alignment)
+            kept_alignment.push_back(std::move((*alignment)[order_[k]]));
+    }
+
+    bounding_box.swap(kept_box);
+    confidence.swap(kept_confidence);
+    if(has_alignment)
+        alignment->swap(kept_alignment);
+}
@@ -0,0 +1,45 @@
+//
+// The non-maximum suppression of the candidate boxes of MTCNN
+//
+
+#ifndef MTCNN_NMS_H
+#define MTCNN_NMS_H
+
+#include <opencv2/opencv.hpp>
+#include <cfloat>
+#include <vector>
+
+/*
+ * NMS is used to suppress the overlapped candidates in one pass. The candidates are sorted by the confidence
+ * once and kept as arrays of floats, then every kept candidate suppresses the overlapped ones after it by a
+ * loop without branch, which the compiler vectorizes. The buffers are kept between the calls, so a detector
+ * should own its NMS.
+ */
+class NMS {
+
+public:
+
+    //the threshold which never suppresses
+    static constexpr float NEVER = FLT_MAX;
+
+    /*
+     * apply() is used to suppress the candidate which overlaps a more confident one, the overlap is the IoU
+     * above threshold_IoU or the IoM above threshold_IoM. A candidate with the confidence of protect or more
+     * is never suppressed. The candidates are kept in the order of the confidence, the alignment is moved
+     * with the boxes if it has one entry per box.
+     */
+    void apply(std::vector<cv::Rect>& bounding_box, std::vector<float>& confidence,
+               std::vector<std::vector<cv::Point>>* alignment,
+               float threshold_IoU, float threshold_IoM = NEVER, float protect = NEVER);
+
+private:
+
+    //the candidates in the order of the confidence
+    std::vector<int> order_;
+    std::vector<float> x1_, y1_, x2_, y2_, area_;
+    std::vector<unsigned char> movable_;
+    std::vector<unsigned char> suppressed_;
+};
+
+
+#endif //MTCNN_NMS_H
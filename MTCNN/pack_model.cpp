@@ -0,0 +1,50 @@
+//
+// The converter of the caffe models of MTCNN to one packed model file of LiteNet
+//
+
+#include "MTCNN.h"
+#include <cstdlib>
+#include <iostream>
+
+/*
+ * pack_model <packed file> [<calibration video> [<frames>]]
+ *
+ * The nets of MTCNNModel(), the models in ./MTCNN/model changed to the row-major images, are packed for the
+ * kernels of LiteNet and written to the packed file, which MTCNNModel(packed_file) maps. With a video, R-Net and
+ * O-Net are quantized to int8 on its first frames, 100 by default, see MTCNN::quantize()
+ */
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        std::cout << "Usage: " << argv[0] << " <packed file> [<calibration video> [<frames>]]" << std::endl;
+        return -1;
+    }
+
+    auto model = std::make_shared<MTCNNModel>();
+
+    if(argc > 2)
+    {
+        cv::VideoCapture video(argv[2]);
+        int count = argc > 3 ? std::atoi(argv[3]) : 100;
+
+        std::vector<cv::Mat> frames;
+        cv::Mat frame;
+        while(frames.size() < count && video.read(frame))
+            frames.push_back(frame.clone());
+        if(frames.empty())
+        {
+            std::cout << "Error: Can not read " << argv[2] << "!" << std::endl;
+            return -1;
+        }
+
+        if(!MTCNN::quantize(model, frames))
+            std::cout << "Error: Some layers are kept in float!" << std::endl;
+    }
+
+    if(!model->save(argv[1]))
+        return -1;
+
+    std::cout << "The nets are packed to " << argv[1] << std::endl;
+    return 0;
+}
@@ -0,0 +1,84 @@
+/**
+ * The filter bank evaluates the passband bins X(k) of a time series x(t), which is zero padded to
+ * getOptimalDFTSize(length) = N as the full dft in ColorMagnify::temporalIdealFilter() does,
+ *
+ * 		Re X(k) = sum x(t) * cos(2*pi*k*t/N),  Im X(k) = -sum x(t) * sin(2*pi*k*t/N)
+ *
+ * and synthesizes the filtered series from these bins alone,
+ *
+ * 		y(t) = sum w(k) * (Re X(k) * cos(2*pi*k*t/N) - Im X(k) * sin(2*pi*k*t/N))
+ *
+ * Both steps are a product with a precomputed basis, so all the series are filtered by two gemm.
+ */
+
+#include "band_filter.h"
+#include "sliding_dft.h"
+
+void BandFilterBank::plan(int _length, double _fl, double _fh, double _rate) {
+	if (_length == length_ && _fl == fl_ && _fh == fh_ && _rate == fps_)
+		return;
+
+	length_ = _length;
+	fl_ = _fl;
+	fh_ = _fh;
+	fps_ = _rate;
+
+	int width = cv::getOptimalDFTSize(_length);
+	int kl, kh;
+	SlidingDFT::passbandBins(width, _fl, _fh, _rate, kl, kh);
+	int bins = kh - kl + 1;
+
+	analysis_.create(_length, 2 * bins, CV_32FC1);
+	synthesis_.create(2 * bins, _length, CV_32FC1);
+
+	for (int b = 0; b < bins; b++) {
+		int k = kl + b;
+		// the conjugate bin of a real signal doubles the weight, except for the nyquist bin
+		double weight = (2 * k == width ? 1.0 : 2.0) / width;
+
+		for (int t = 0; t < _length; t++) {
+			double phase = 2 * CV_PI * k * t / width;
+			float c = (float)std::cos(phase);
+			float s = (float)std::sin(phase);
+
+			analysis_.at<float>(t, 2 * b) = c;
+			analysis_.at<float>(t, 2 * b + 1) = -s;
+			synthesis_.at<float>(2 * b, t) = (float)(weight * c);
+			synthesis_.at<float>(2 * b + 1, t) = (float)(-weight * s);
+		}
+	}
+}
+
+void BandFilterBank::apply(const cv::Mat &_src, cv::Mat &_dst) {
+	// passband bins of every series
+	cv::gemm(_src, analysis_, 1, cv::noArray(), 0, spectrum_);
+
+	// synthesize the series from the passband bins
+	cv::gemm(spectrum_, synthesis_, 1, cv::noArray(), 0, _dst);
+}
+
+void BandFilterBank::applyInPlace(cv::Mat &_series) {
+	// passband bins of every series, (2 * bins) * series
+	cv::gemm(analysis_, _series, 1, cv::noArray(), 0, spectrum_, cv::GEMM_1_T);
+
+	// synthesize the series from the passband bins into the buffer
+	cv::gemm(synthesis_, spectrum_, 1, cv::noArray(), 0, _series, cv::GEMM_1_T);
+}
+
+void BandFilterBank::newest(const cv::Mat &_series, int _oldest, cv::Mat &_dst) {
+	int length = _series.rows;
+
+	// the slots from the oldest one to the end of the ring are the first frames of the window
+	cv::gemm(analysis_.rowRange(0, length - _oldest), _series.rowRange(_oldest, length),
+			 1, cv::noArray(), 0, spectrum_, cv::GEMM_1_T);
+
+	// the slots before the oldest one wrap around to the end of the window
+	if (_oldest > 0) {
+		cv::gemm(analysis_.rowRange(length - _oldest, length), _series.rowRange(0, _oldest),
+				 1, cv::noArray(), 0, spectrum_wrapped_, cv::GEMM_1_T);
+		spectrum_ += spectrum_wrapped_;
+	}
+
+	// synthesize the last frame of the window only
+	cv::gemm(synthesis_.col(length - 1), spectrum_, 1, cv::noArray(), 0, _dst, cv::GEMM_1_T);
+}
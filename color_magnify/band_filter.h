@@ -0,0 +1,68 @@
+#ifndef BAND_FILTER_H
+#define BAND_FILTER_H
+
+#include <opencv2/opencv.hpp>
+
+
+/**
+ * BandFilterBank is used to temporal filter a group of time series with an ideal band-pass filter,
+ * only the bins in the passband are evaluated and the time series is synthesized from these bins alone
+ */
+class BandFilterBank {
+public:
+    BandFilterBank() {}
+    ~BandFilterBank() {}
+
+    /**
+     * plan() is used to precompute the analysis and synthesis basis of the passband bins,
+     * it is skipped if the basis has been computed with the same parameters
+     *
+     * @param length        : the length of the time series
+     * @param fl            : low frequence cut-off
+     * @param fh            : high frequence cut-off
+     * @param fps           : the frame per second of the video
+     */
+    void plan(int length, double fl, double fh, double fps);
+
+    /**
+     * apply() is used to filter the time series
+     *
+     * @param src           : source time series, one row per series, which is a CV_32FC1 format
+     * @param dst           : output the filtered time series, which has the same size of src
+     */
+    void apply(const cv::Mat &src, cv::Mat &dst);
+
+    /**
+     * applyInPlace() is used to filter the time series of a time-major buffer in place
+     *
+     * @param series        : the time series, one row per frame and one column per series, which is a CV_32FC1 format
+     */
+    void applyInPlace(cv::Mat &series);
+
+    /**
+     * newest() is used to filter a ring of time series and get the filtered value of the newest frame only
+     *
+     * @param series        : the ring, one row per slot and one column per series, which is a CV_32FC1 format
+     * @param oldest        : the slot of the oldest frame, the newest frame is the slot before it
+     * @param dst           : output the filtered value of the newest frame, 1 * series
+     */
+    void newest(const cv::Mat &series, int oldest, cv::Mat &dst);
+
+    int bins() const { return analysis_.cols / 2; }
+
+private:
+    int length_ = 0;
+    double fl_ = 0;
+    double fh_ = 0;
+    double fps_ = 0;
+
+    //length * (2 * bins), the cos and -sin of every bin
+    cv::Mat analysis_;
+    //(2 * bins) * length, the weighted cos and -sin used to synthesize the time series
+    cv::Mat synthesis_;
+    //the real and imaginary part of the passband bins of every series
+    cv::Mat spectrum_;
+    cv::Mat spectrum_wrapped_;
+};
+
+#endif //BAND_FILTER_H
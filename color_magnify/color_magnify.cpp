@@ -9,14 +9,71 @@
  */
 
 #include "color_magnify.h"
+#include <cfloat>
+
+namespace {
+
+// rows of a tile of the combined frame
+const int kTileRows = 16;
+
+/**
+ * addRange() is used to add the up sampled frame to the source frame and find the range of the sum in one pass,
+ * the sum is the same as converting the source frame to CV_32FC3 and adding them
+ */
+template<typename T>
+void addRange(const cv::Mat &src, const cv::Mat &upSampled, cv::Mat &combined, double &minVal, double &maxVal) {
+	int tiles = (src.rows + kTileRows - 1) / kTileRows;
+	int width = src.cols * 3;
+	std::vector<float> tileMin(tiles), tileMax(tiles);
+
+	cv::parallel_for_(cv::Range(0, tiles), [&](const cv::Range &range) {
+		for (int tile = range.start; tile < range.end; tile++) {
+			float lo = FLT_MAX, hi = -FLT_MAX;
+			for (int y = tile * kTileRows; y < std::min(src.rows, (tile + 1) * kTileRows); y++) {
+				const T *s = src.ptr<T>(y);
+				const float *u = upSampled.ptr<float>(y);
+				float *d = combined.ptr<float>(y);
+				for (int x = 0; x < width; x++) {
+					float v = (float)s[x] + u[x];
+					d[x] = v;
+					lo = std::min(lo, v);
+					hi = std::max(hi, v);
+				}
+			}
+			tileMin[tile] = lo;
+			tileMax[tile] = hi;
+		}
+	});
+
+	minVal = *std::min_element(tileMin.begin(), tileMin.end());
+	maxVal = *std::max_element(tileMax.begin(), tileMax.end());
+}
+
+}
 
 cv::Mat ColorMagnify::get_filtered_img(std::vector<cv::Mat>_src, int _fps, float _magnify_coeff,
-								   double _low_freq, double _high_freq, int _pyramid_level) {
+								   double _low_freq, double _high_freq, int _pyramid_level, TemporalFilter _filter) {
+	if (_filter != IDEAL_FILTER) {
+		// down sampled frames written directly into the history
+		PixelHistory history;
+		downSample(_src, _pyramid_level, history);
+
+		// filtered in place
+		temporalBandLimitedFilter(history, _low_freq, _high_freq, _fps);
+
+		// normalized concatenated image
+		double minVal, maxVal;
+		history.minMax(minVal, maxVal);
+		double scale = maxVal - minVal > DBL_EPSILON ? 1.0 / (maxVal - minVal) : 0.0;
+
+		cv::Mat filtered;
+		history.concat(filtered, scale, -minVal * scale);
+		return filtered;
+	}
+
 	// down sampled frames - space filter
 	std::vector<cv::Mat> downSampledFrames;
 	for(auto & src : _src) {
-		//the _src img will change to float in flowing steps
-		src.convertTo(src, CV_32FC3);
 		// Gaussian pyramid
 		auto pyramid = buildGaussianPyramid(src, _pyramid_level);
 		downSampledFrames.push_back(std::move(pyramid));
@@ -32,13 +89,37 @@ cv::Mat ColorMagnify::get_filtered_img(std::vector<cv::Mat>_src, int _fps, float
 }
 
 std::vector<cv::Mat> ColorMagnify::get_combined_img(std::vector<cv::Mat>_src, int _fps, float _magnify_coeff,
-                       			double _low_freq, double _high_freq, int _pyramid_level) {
+                       			double _low_freq, double _high_freq, int _pyramid_level, TemporalFilter _filter) {
+
+	if (_filter != IDEAL_FILTER) {
+		// down sampled frames written directly into the history
+		PixelHistory history;
+		downSample(_src, _pyramid_level, history);
+
+		// filtered in place
+		temporalBandLimitedFilter(history, _low_freq, _high_freq, _fps);
+
+		// the normalize and amplify are applied while the frames are read out of the history
+		double minVal, maxVal;
+		history.minMax(minVal, maxVal);
+		double scale = maxVal - minVal > DBL_EPSILON ? _magnify_coeff / (maxVal - minVal) : 0.0;
+
+		// the frames are independent, so they are reconstructed in parallel
+		std::vector<cv::Mat> output(_src.size());
+		cv::parallel_for_(cv::Range(0, (int)_src.size()), [&](const cv::Range &range) {
+			cv::Mat amplified;
+			for (int j = range.start; j < range.end; j++) {
+				history.frame(j, amplified, scale, -minVal * scale);
+				output[j] = combine(_src[j], amplified, _pyramid_level);
+			}
+		});
+
+		return output;
+	}
 
 	// down sampled frames - space filter
 	std::vector<cv::Mat> downSampledFrames;
 	for(auto & src : _src) {
-		//the _src img will change to float in flowing steps
-		src.convertTo(src, CV_32FC3);
 		// Gaussian pyramid
 		auto pyramid = buildGaussianPyramid(src, _pyramid_level);
 		downSampledFrames.push_back(std::move(pyramid));
@@ -56,29 +137,284 @@ std::vector<cv::Mat> ColorMagnify::get_combined_img(std::vector<cv::Mat>_src, in
 	// frames after temporal filtering
 	auto filteredFrames = deConcat(amplified, downSampledFrames[0].size());
 
-	std::vector<cv::Mat> output;
-	for (int j=0; j < _src.size(); j++) {
+	// the frames are independent, so they are reconstructed in parallel
+	std::vector<cv::Mat> output(_src.size());
+	cv::parallel_for_(cv::Range(0, (int)_src.size()), [&](const cv::Range &range) {
+		for (int j = range.start; j < range.end; j++) {
+			output[j] = combine(_src[j], filteredFrames[j], _pyramid_level);
+		}
+	});
+
+	return output;
+}
 
-		// color image
-		auto upSampled = upsamplingFromGaussianPyramid(filteredFrames[j], _pyramid_level);
+void ColorMagnify::set_stream(int _window_length, int _fps, float _magnify_coeff,
+							  double _low_freq, double _high_freq, int _pyramid_level, TemporalFilter _filter) {
+	if (_window_length < 1) {
+		perror("Window length should be larger than 0");
+	}
+	stream_window_ = _window_length;
+	stream_fps_ = _fps;
+	stream_alpha_ = _magnify_coeff;
+	stream_low_freq_ = _low_freq;
+	stream_high_freq_ = _high_freq;
+	stream_level_ = _pyramid_level;
+	stream_filter_ = _filter;
+
+	reset_stream();
+}
 
-		cv::resize(upSampled, upSampled, _src[j].size());
-		
-		// combined image
-		cv::Mat combined = _src[j] + upSampled;
-		
+void ColorMagnify::reset_stream() {
+	stream_history_ = PixelHistory();
+	stream_ordered_.release();
+
+	stream_old_.release();
+	stream_filtered_.release();
+	stream_min_.clear();
+	stream_max_.clear();
+	stream_updates_ = 0;
+
+	stream_means_.clear();
+	heart_filtered_.release();
+}
+
+cv::Mat ColorMagnify::push_filtered_img(const cv::Mat &frame) {
+	push_stream(frame);
+
+	if (stream_history_.count() == 0)
+		return cv::Mat();
+
+	return filter_stream();
+}
+
+cv::Mat ColorMagnify::push_combined_img(const cv::Mat &frame) {
+	push_stream(frame);
+
+	if (stream_history_.count() == 0)
+		return cv::Mat();
+
+	// amplified image of the newest frame
+	auto amplified = amplify(filter_stream(), stream_alpha_);
+
+	return combine(frame, amplified, stream_level_);
+}
+
+HeartRate ColorMagnify::push_heart_rate(const cv::Mat &frame, cv::Rect face) {
+	push_stream(frame, true);
+
+	if (stream_history_.count() == 0)
+		return HeartRate();
+
+	// the mean of the newest frame, the slot before the head
+	int slot = (stream_history_.head() + stream_window_ - 1) % stream_window_;
+	int last = (slot + stream_window_ - 1) % stream_window_;
+	const float *hold = stream_history_.count() > 1 ? &stream_means_[last] : nullptr;
+	stream_means_[slot] = faceMean(stream_history_, slot, face, stream_level_, hold);
+
+	// the means of the window in time order
+	int count = stream_history_.count();
+	heart_signal_.create(1, count, CV_32FC1);
+	float *signal = heart_signal_.ptr<float>();
+	for (int t = 0; t < count; t++) {
+		signal[t] = stream_means_[stream_history_.slotOf(t)];
+	}
+
+	return estimateHeartRate(heart_signal_, stream_fps_, stream_low_freq_, stream_high_freq_);
+}
+
+HeartRate ColorMagnify::get_heart_rate(const std::vector<cv::Mat> &_src, int _fps, double _low_freq,
+									   double _high_freq, int _pyramid_level, cv::Rect _face) {
+	if (_src.empty())
+		return HeartRate();
+
+	// down sampled frames written directly into the history, nothing is up sampled afterwards
+	PixelHistory history;
+	downSample(_src, _pyramid_level, history);
+
+	// the mean of the face in every frame, the filter is linear so the mean is taken before filtering
+	heart_signal_.create(1, history.count(), CV_32FC1);
+	float *signal = heart_signal_.ptr<float>();
+	for (int j = 0; j < history.count(); j++) {
+		signal[j] = faceMean(history, j, _face, _pyramid_level, j > 0 ? &signal[j - 1] : nullptr);
+	}
+
+	return estimateHeartRate(heart_signal_, _fps, _low_freq, _high_freq);
+}
+
+void ColorMagnify::push_stream(const cv::Mat &frame, bool headless) {
+	if (stream_window_ < 1) {
+		perror("The stream should be set before pushing frames");
+		return;
+	}
+
+	auto size = pyrDownSize(frame.size(), stream_level_);
+
+	// the ring is allocated once, a new frame size or switching the headless mode restarts the stream
+	if (size != stream_history_.size() || headless != stream_headless_) {
+		reset_stream();
+		stream_headless_ = headless;
+		stream_history_.create(size, 3, stream_window_);
+		stream_means_.assign(stream_window_, 0.f);
+		if (stream_filter_ == SLIDING_DFT_FILTER) {
+			stream_sdft_.init(stream_history_.slot(0).cols, stream_window_, stream_low_freq_, stream_high_freq_, stream_fps_);
+		}
+		if (stream_filter_ != IDEAL_FILTER) {
+			stream_filtered_ = cv::Mat::zeros(stream_history_.slot(0).size(), CV_32FC1);
+			stream_min_.assign(stream_window_, 0.f);
+			stream_max_.assign(stream_window_, 0.f);
+		}
+	}
+
+	int slot = stream_history_.head();
+
+	// the oldest frame leaves the window, an unfilled slot of the ring is zero
+	if (stream_filter_ == SLIDING_DFT_FILTER && !headless) {
+		stream_history_.slot(slot).copyTo(stream_old_);
+	}
+
+	// Gaussian pyramid written directly over the oldest slot of the ring
+	std::vector<cv::Mat> planes;
+	for (int c = 0; c < 3; c++) {
+		planes.push_back(stream_history_.plane(slot, c));
+	}
+	pyrDownLevels(frame, planes, stream_level_, fused_pyramid_);
+	stream_history_.advance();
+
+	// the heart rate filters the mean of the face over the whole window instead
+	if (headless)
+		return;
+
+	if (stream_filter_ == SLIDING_DFT_FILTER) {
+		stream_sdft_.update(stream_history_.slot(slot), stream_old_, stream_filtered_);
+
+		// recompute the bins once per window to drop the rounding error of the updates
+		if (++stream_updates_ % stream_window_ == 0) {
+			stream_sdft_.resync(stream_history_);
+		}
+	} else if (stream_filter_ == BAND_LIMITED_FILTER) {
+		// the unfilled slots are zero and older than the filled ones, so the window starts at the head slot
+		band_filter_.plan(stream_window_, stream_low_freq_, stream_high_freq_, stream_fps_);
+		for (int c = 0; c < 3; c++) {
+			cv::Mat line = stream_filtered_.colRange(c * stream_history_.stride(),
+													 c * stream_history_.stride() + stream_history_.size().area());
+			band_filter_.newest(stream_history_.channel(c), stream_history_.head(), line);
+		}
+	}
+
+	if (stream_filter_ != IDEAL_FILTER) {
 		double minVal, maxVal;
-		cv::minMaxLoc(combined, &minVal, &maxVal);//find minimun and maximum intensities
-		
-		// int formated frame
-		cv::Mat formated;
-		combined.convertTo(formated, CV_8UC3, 255.0 / (maxVal - minVal),
-			(-minVal * 255.0 / (maxVal - minVal)));
+		stream_history_.minMax(stream_filtered_, minVal, maxVal);
+		stream_min_[slot] = (float)minVal;
+		stream_max_[slot] = (float)maxVal;
+	}
+}
+
+cv::Mat ColorMagnify::filter_stream() {
+	int count = stream_history_.count();
+
+	if (stream_filter_ != IDEAL_FILTER) {
+		// normalize the newest filtered frame with the range of the filtered frames in the window
+		float minVal = *std::min_element(stream_min_.begin(), stream_min_.begin() + count);
+		float maxVal = *std::max_element(stream_max_.begin(), stream_max_.begin() + count);
 
-		output.push_back(std::move(formated));
+		double range = maxVal - minVal;
+		double scale = range > DBL_EPSILON ? 1.0 / range : 0.0;
+
+		cv::Mat normalized;
+		stream_history_.frame(stream_filtered_, normalized, scale, -minVal * scale);
+
+		return normalized;
 	}
 
-	return output;
+	// put the frames of the ring in time order, the oldest frame first
+	stream_history_.concat(stream_ordered_);
+
+	// filtered image of the window
+	auto filtered = temporalIdealFilter(stream_ordered_, stream_low_freq_, stream_high_freq_, stream_fps_);
+
+	// the newest frame is the last column
+	return filtered.col(count - 1).clone().reshape(3, stream_history_.size().height);
+}
+
+float ColorMagnify::faceMean(const PixelHistory &history, int slot, const cv::Rect &face, const int _pyramid_level,
+							 const float *hold) {
+	cv::Rect frame(cv::Point(0, 0), history.size());
+
+	// the face region scaled to the down sampled frame, at least one pixel is kept
+	cv::Rect region = frame;
+	if (face.area() > 0) {
+		int scale = 1 << _pyramid_level;
+		cv::Point tl(face.x / scale, face.y / scale);
+		cv::Point br((face.x + face.width + scale - 1) / scale, (face.y + face.height + scale - 1) / scale);
+		region = cv::Rect(tl, br) & frame;
+
+		// a face out of the frame holds the last mean, so the signal has no step of the whole frame
+		if (region.area() == 0) {
+			if (hold)
+				return *hold;
+			region = frame;
+		}
+	}
+
+	// the green channel carries most of the pulse
+	return (float)cv::mean(history.plane(slot, 1)(region))[0];
+}
+
+HeartRate ColorMagnify::estimateHeartRate(const cv::Mat &signal, double _fps, double _low_freq, double _high_freq) {
+	int length = signal.cols;
+	if (length < 2)
+		return HeartRate();
+
+	// band-passed signal of the face
+	band_filter_.plan(length, _low_freq, _high_freq, _fps);
+	band_filter_.apply(signal, heart_filtered_);
+
+	heart_series_.assign(heart_filtered_.ptr<float>(), heart_filtered_.ptr<float>() + length);
+	return heart_rate_.estimate(heart_series_, _fps, _low_freq, _high_freq);
+}
+
+void ColorMagnify::downSample(const std::vector<cv::Mat> &_src, const int _pyramid_level, PixelHistory &history) {
+	if (_src.empty())
+		return;
+
+	history.create(pyrDownSize(_src[0].size(), _pyramid_level), 3, _src.size());
+
+	for (auto & src : _src) {
+		// Gaussian pyramid written directly into the planes of the newest slot
+		std::vector<cv::Mat> planes;
+		for (int c = 0; c < 3; c++) {
+			planes.push_back(history.plane(history.head(), c));
+		}
+		pyrDownLevels(src, planes, _pyramid_level, fused_pyramid_);
+		history.advance();
+	}
+}
+
+cv::Mat ColorMagnify::combine(const cv::Mat &src, const cv::Mat &filtered, const int _pyramid_level) {
+	// color image
+	auto upSampled = upsamplingFromGaussianPyramid(filtered, _pyramid_level);
+
+	// the up sampled frame of an even size needs no resize
+	if (upSampled.size() != src.size())
+		cv::resize(upSampled, upSampled, src.size());
+
+	// combined image and its minimun and maximum intensities in one pass over the tiles
+	cv::Mat combined(src.size(), CV_32FC3);
+	double minVal, maxVal;
+	if (src.depth() == CV_8U) {
+		addRange<uchar>(src, upSampled, combined, minVal, maxVal);
+	} else {
+		cv::Mat source;
+		src.convertTo(source, CV_32FC3);
+		addRange<float>(source, upSampled, combined, minVal, maxVal);
+	}
+
+	// int formated frame
+	cv::Mat formated;
+	combined.convertTo(formated, CV_8UC3, 255.0 / (maxVal - minVal),
+		(-minVal * 255.0 / (maxVal - minVal)));
+
+	return formated;
 }
 
 cv::Mat ColorMagnify::temporalIdealFilter(const cv::Mat &src, double _fl, double _fh, double _rate) {
@@ -102,12 +438,18 @@ cv::Mat ColorMagnify::temporalIdealFilter(const cv::Mat &src, double _fl, double
 		// do the DFT
 		cv::dft(tempImg, tempImg, cv::DFT_ROWS | cv::DFT_SCALE);
 
-		// construct the filter
-		cv::Mat filter = tempImg.clone();
-		createIdealBandpassFilter(filter, _fl, _fh, _rate);
+		// construct the filter once for the same size and cut-off
+		if (ideal_filter_.size() != tempImg.size() || ideal_filter_key_[0] != _fl ||
+			ideal_filter_key_[1] != _fh || ideal_filter_key_[2] != _rate) {
+			ideal_filter_.create(tempImg.size(), CV_32FC1);
+			createIdealBandpassFilter(ideal_filter_, _fl, _fh, _rate);
+			ideal_filter_key_[0] = _fl;
+			ideal_filter_key_[1] = _fh;
+			ideal_filter_key_[2] = _rate;
+		}
 
 		// apply filter
-		cv::mulSpectrums(tempImg, filter, tempImg, cv::DFT_ROWS);
+		cv::mulSpectrums(tempImg, ideal_filter_, tempImg, cv::DFT_ROWS);
 
 		// do the inverse DFT on filtered image
 		cv::idft(tempImg, tempImg, cv::DFT_ROWS | cv::DFT_SCALE);
@@ -135,17 +477,25 @@ void ColorMagnify::createIdealBandpassFilter(cv::Mat &filter, double _fl, double
 	auto fl = 2 * _fl * width / _rate;
 	auto fh = 2 * _fh * width / _rate;
 
-	double response;
+	// the response is the same for every row
+	float *response = filter.ptr<float>(0);
+	for (int j = 0; j < width; ++j) {
+		response[j] = (j >= fl && j <= fh) ? 1.0f : 0.0f;
+	}
 
-	for (int i = 0; i < height; ++i) {
-		for (int j = 0; j < width; ++j) {
-			// filter response
-			if (j >= fl && j <= fh)
-				response = 1.0f;
-			else
-				response = 0.0f;
-			filter.at<float>(i, j) = response;
-		}
+	for (int i = 1; i < height; ++i) {
+		filter.row(0).copyTo(filter.row(i));
+	}
+}
+
+void ColorMagnify::temporalBandLimitedFilter(PixelHistory &history, double _fl, double _fh, double _rate) {
+	// precompute the basis of the passband once for the same length and cut-off
+	band_filter_.plan(history.capacity(), _fl, _fh, _rate);
+
+	// the time series of every channel are filtered in place, one row per frame
+	for (int c = 0; c < history.channels(); ++c) {
+		cv::Mat series = history.channel(c);
+		band_filter_.applyInPlace(series);
 	}
 }
 
@@ -153,19 +503,18 @@ cv::Mat ColorMagnify::buildGaussianPyramid(const cv::Mat &img, const int levels)
 	if (levels < 1) {
 		perror("Levels should be larger than 1");
 	}
-	auto result = img;
-	for (int l = 0; l<levels; l++) {
-		cv::Mat down;
-		cv::pyrDown(result, down);
-		result = std::move(down);
-	}
+
+	// the input frame could be CV_8UC3, the result is CV_32FC3
+	cv::Mat result;
+	pyrDownLevels(img, result, levels, fused_pyramid_);
 
 	return result;
 }
 
 
 cv::Mat ColorMagnify::upsamplingFromGaussianPyramid(const cv::Mat src, const int levels) {
-	cv::Mat result = src.clone();
+	// pyrUp never writes to its source, so the source needs no copy
+	cv::Mat result = src;
 	for (int i = 0; i < levels; i++) {
 		cv::Mat up;
 		cv::pyrUp(result, up);
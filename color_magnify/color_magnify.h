@@ -4,10 +4,24 @@
 #include <opencv2/opencv.hpp>
 #include <string>
 #include <vector>
+#include "sliding_dft.h"
+#include "band_filter.h"
+#include "pixel_history.h"
+#include "pyramid.h"
+#include "heart_rate.h"
 
 
 class ColorMagnify {
 public:
+    /**
+     * the temporal filter used for the window
+     */
+    enum TemporalFilter {
+        IDEAL_FILTER,           // dft of the whole window, mask and inverse dft
+        SLIDING_DFT_FILTER,     // update the passband bins when the window moves by one frame, stream only
+        BAND_LIMITED_FILTER     // evaluate and synthesize the passband bins only
+    };
+
     ColorMagnify() {}
     ~ColorMagnify() {}
 
@@ -21,9 +35,11 @@ public:
      * @param low_freq      : the low frequence cut-off. In face, it would better be set as 0.83
      * @param high_freq     : the high frequence cut-off. In face, it would better be set as 1.0
      * @param pyramid_level : the pyramid level used for down sampling
+     * @param filter        : the temporal filter used for the window
      */
     std::vector<cv::Mat> get_combined_img(std::vector<cv::Mat>src, int fps = 30, float magnify_alpha = 50.f,
-                  double low_freq = 0.83f, double high_freq = 1.0f, int pyramid_level = 4);
+                  double low_freq = 0.83f, double high_freq = 1.0f, int pyramid_level = 4,
+                  TemporalFilter filter = IDEAL_FILTER);
 
     /**
      * ColorMagnify() faction is used to magnify the color of the face to detect heart rate
@@ -34,17 +50,100 @@ public:
      * @param low_freq      : the low frequence cut-off. In face, it would better be set as 0.83
      * @param high_freq     : the high frequence cut-off. In face, it would better be set as 1.0
      * @param pyramid_level : the pyramid level used for down sampling
+     * @param filter        : the temporal filter used for the window
      * @return              : return the filtered image
      */
     cv::Mat get_filtered_img(std::vector<cv::Mat>src, int fps = 30, float magnify_alpha = 50.f,
-                             double low_freq = 0.83f, double high_freq = 1.0f, int pyramid_level = 4);
+                             double low_freq = 0.83f, double high_freq = 1.0f, int pyramid_level = 4,
+                             TemporalFilter filter = IDEAL_FILTER);
+
+    /**
+     * set_stream() is used to start the push-style streaming mode. Only the down sampled frames of the
+     * last window_length frames are kept in a fixed-size ring, so the memory does not grow with the stream
+     *
+     * @param window_length : the number of frames in the temporal filter window
+     * @param fps           : the frame per second of the video
+     * @param magnify_coeff : the coefficient of the magnify
+     * @param low_freq      : the low frequence cut-off. In face, it would better be set as 0.83
+     * @param high_freq     : the high frequence cut-off. In face, it would better be set as 1.0
+     * @param pyramid_level : the pyramid level used for down sampling
+     * @param filter        : the temporal filter used for the window
+     */
+    void set_stream(int window_length, int fps = 30, float magnify_alpha = 50.f,
+                    double low_freq = 0.83f, double high_freq = 1.0f, int pyramid_level = 4,
+                    TemporalFilter filter = SLIDING_DFT_FILTER);
+
+    /**
+     * reset_stream() is used to drop the history of the stream, the settings of set_stream() are kept
+     */
+    void reset_stream();
+
+    /**
+     * set_fused_pyramid() is used to down sample the frames by pyrDownFused() instead of cv::pyrDown of every
+     * level, see pyrDownLevels()
+     *
+     * @param fused         : down sample by pyrDownFused()
+     */
+    void set_fused_pyramid(bool fused) { fused_pyramid_ = fused; }
+
+    /**
+     * push_filtered_img() is used to push one frame into the stream and get the filtered result of it
+     *
+     * @param frame         : the input frame
+     * @return              : the filtered down sampled frame, which is a CV_32FC3 format, or empty if the stream
+     *                        is not set
+     */
+    cv::Mat push_filtered_img(const cv::Mat &frame);
+
+    /**
+     * push_combined_img() is used to push one frame into the stream and get the combined result of it
+     *
+     * @param frame         : the input frame
+     * @return              : the frame with the magnified color, which is a CV_8UC3 format, or empty if the
+     *                        stream is not set
+     */
+    cv::Mat push_combined_img(const cv::Mat &frame);
+
+    /**
+     * get_heart_rate() is used to estimate the heart rate of the frames without magnifying them. The band-passed
+     * signal is averaged over the face, so the frames are never up sampled, resized or converted to CV_8UC3
+     *
+     * @param src           : the input frames
+     * @param fps           : the frame per second of the video
+     * @param low_freq      : the low frequence cut-off. In face, it would better be set as 0.83
+     * @param high_freq     : the high frequence cut-off. In face, it would better be set as 1.0
+     * @param pyramid_level : the pyramid level used for down sampling
+     * @param face          : the face region in the input frames, the whole frame is used if it is empty
+     * @return              : the heart rate and the confidence of it
+     */
+    HeartRate get_heart_rate(const std::vector<cv::Mat> &src, int fps = 30, double low_freq = 0.83f,
+                             double high_freq = 1.0f, int pyramid_level = 4, cv::Rect face = cv::Rect());
+
+    /**
+     * push_heart_rate() is used to push one frame into the stream and estimate the heart rate of the window,
+     * the frames are not filtered one by one, so it should not be mixed with push_filtered_img() and
+     * push_combined_img() on the same stream. Switching between them restarts the stream
+     *
+     * @param frame         : the input frame
+     * @param face          : the face region in the input frame, the whole frame is used if it is empty, a face
+     *                        out of the frame holds the mean of the last frame
+     * @return              : the heart rate and the confidence of it
+     */
+    HeartRate push_heart_rate(const cv::Mat &frame, cv::Rect face = cv::Rect());
+
+    /**
+     * get_heart_signal() is used to get the band-passed mean of the face of the last heart rate estimation
+     *
+     * @return              : the signal in time order, which is a 1 * T CV_32FC1 format
+     */
+    const cv::Mat &get_heart_signal() const { return heart_filtered_; }
 
     /**
      * buildGaussianPyramid() is used to build a gaussian pyramid, which is always used in color magnify
      *
-     * @param img           : the input frames
+     * @param img           : the input frames, which is a CV_8UC3 or CV_32FC3 format
      * @param pyramid_level : the pyramid level used for down sampling
-     * @return              : output the frame with down sampling
+     * @return              : output the frame with down sampling, which is a CV_32FC3 format
      */
 	cv::Mat buildGaussianPyramid(const cv::Mat &img, const int pyramid_level);
 
@@ -89,6 +188,18 @@ public:
     cv::Mat temporalIdealFilter(const cv::Mat &src, double fl, double fh, double fps);
 
 
+    /**
+     * temporalBandLimitedFilter() is used to temporal filtering the down sampled frames in place,
+     * only the bins between fl and fh are evaluated, which is much cheaper than the dft of the whole spectrum
+     *
+     * @param history       : the down sampled frames of the window, the oldest frame is in slot 0
+     * @param fl            : low frequence cut-off
+     * @param fh            : high frequence cut-off
+     * @param fps           : the frame per second of the video
+     */
+    void temporalBandLimitedFilter(PixelHistory &history, double fl, double fh, double fps);
+
+
     /**
      * createIdealBandpassFilter() is used to create a 1D ideal band-pass filter
      * @param filter        : source image to be filtered
@@ -107,5 +218,105 @@ public:
      * @return              : return the amplified image
      */
 	cv::Mat amplify(const cv::Mat src, const float magnify_coeff);
+
+private:
+    /**
+     * downSample() is used to write the down sampled frames into the history
+     *
+     * @param src           : the input frames
+     * @param pyramid_level : the pyramid level used for down sampling
+     * @param history       : output the down sampled frames, one slot per frame
+     */
+    void downSample(const std::vector<cv::Mat> &src, const int pyramid_level, PixelHistory &history);
+
+    /**
+     * combine() is used to add the up sampled filtered frame to the source frame and format it to CV_8UC3
+     *
+     * @param src           : the source frame
+     * @param filtered      : the amplified down sampled frame
+     * @param pyramid_level : the pyramid level used for up sampling
+     * @return              : the combined frame
+     */
+    cv::Mat combine(const cv::Mat &src, const cv::Mat &filtered, const int pyramid_level);
+
+    /**
+     * push_stream() is used to down sample a frame and write it into the ring of the stream
+     *
+     * @param frame         : the input frame
+     * @param headless      : only the ring is written, the frame is not filtered
+     */
+    void push_stream(const cv::Mat &frame, bool headless = false);
+
+    /**
+     * filter_stream() is used to temporal filter the frames in the ring
+     *
+     * @return              : the filtered down sampled frame of the newest frame
+     */
+    cv::Mat filter_stream();
+
+    /**
+     * faceMean() is used to average the green channel of a slot over the face region
+     *
+     * @param history       : the down sampled frames
+     * @param slot          : the index of the slot
+     * @param face          : the face region in the input frames
+     * @param pyramid_level : the pyramid level used for down sampling
+     * @param hold          : the mean of the frame before, which is kept if the face is out of the frame, the
+     *                        whole frame is used then if it is null
+     * @return              : the mean of the region
+     */
+    float faceMean(const PixelHistory &history, int slot, const cv::Rect &face, const int pyramid_level,
+                   const float *hold = nullptr);
+
+    /**
+     * estimateHeartRate() is used to band-pass the mean signal of the face and locate its spectral peak
+     *
+     * @param signal        : the mean of the face in every frame, in time order
+     * @param fps           : the frame per second of the video
+     * @param low_freq      : the low frequence cut-off
+     * @param high_freq     : the high frequence cut-off
+     * @return              : the heart rate and the confidence of it
+     */
+    HeartRate estimateHeartRate(const cv::Mat &signal, double fps, double low_freq, double high_freq);
+
+    //the gaussian pyramid is built by pyrDownFused() instead of cv::pyrDown
+    bool fused_pyramid_ = false;
+
+    //the ideal band-pass filter is kept for the same size and cut-off
+    cv::Mat ideal_filter_;
+    double ideal_filter_key_[3] = {0, 0, 0};
+
+    //the passband basis of the band limited filter
+    BandFilterBank band_filter_;
+
+    //param for the stream
+    int stream_window_ = 0;
+    int stream_fps_ = 30;
+    float stream_alpha_ = 50.f;
+    double stream_low_freq_ = 0.83f;
+    double stream_high_freq_ = 1.0f;
+    int stream_level_ = 4;
+    TemporalFilter stream_filter_ = SLIDING_DFT_FILTER;
+
+    //variable for the stream, the history is used as the ring of the down sampled frames
+    PixelHistory stream_history_;
+    cv::Mat stream_ordered_;
+
+    //variable for the sliding dft and band limited filter, the newest filtered frame is planar like a slot,
+    //the range of the filtered frames in the window is used to normalize
+    SlidingDFT stream_sdft_;
+    cv::Mat stream_old_;
+    cv::Mat stream_filtered_;
+    std::vector<float> stream_min_;
+    std::vector<float> stream_max_;
+    int stream_updates_ = 0;
+
+    //variable for the heart rate, the mean of the face in every slot of the ring
+    bool stream_headless_ = false;
+    std::vector<float> stream_means_;
+    cv::Mat heart_signal_;
+    cv::Mat heart_filtered_;
+    std::vector<float> heart_series_;
+    HeartRateEstimator heart_rate_;
 };
 #endif //COLORMODIFY_H
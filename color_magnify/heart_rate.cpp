@@ -0,0 +1,204 @@
+#include "heart_rate.h"
+
+HeartRate HeartRateEstimator::estimate(const std::vector<float> &signal, double _fps, double _low_freq,
+									   double _high_freq, double _resolution_bpm) {
+	HeartRate result;
+	int length = signal.size();
+	if (length < 2)
+		return result;
+
+	// the step of the grid is fps / width, so the signal is zero padded to reach the resolution
+	int width = cv::getOptimalDFTSize(std::max(length, cvCeil(_fps * 60 / _resolution_bpm)));
+
+	// the mean of the signal is removed, it would leak into the low bins
+	double mean = 0;
+	for (auto value : signal)
+		mean += value;
+	mean /= length;
+
+	padded_.create(1, width, CV_32FC1);
+	padded_.setTo(cv::Scalar::all(0));
+	float *padded = padded_.ptr<float>();
+	for (int t = 0; t < length; t++)
+		padded[t] = (float)(signal[t] - mean);
+
+	cv::dft(padded_, spectrum_, cv::DFT_COMPLEX_OUTPUT);
+
+	// power of the bins up to the nyquist bin
+	int nyquist = width / 2;
+	const cv::Vec2f *bins = spectrum_.ptr<cv::Vec2f>();
+	std::vector<double> power(nyquist + 1, 0.0);
+	double total = 0;
+	for (int k = 1; k <= nyquist; k++) {
+		power[k] = (double)bins[k][0] * bins[k][0] + (double)bins[k][1] * bins[k][1];
+		total += power[k];
+	}
+
+	int kl = std::max(1, cvCeil(_low_freq * width / _fps));
+	int kh = std::min(nyquist, cvFloor(_high_freq * width / _fps));
+	if (kl > kh || total <= 0)
+		return result;
+
+	int peak = kl;
+	for (int k = kl + 1; k <= kh; k++) {
+		if (power[k] > power[peak])
+			peak = k;
+	}
+
+	// the main lobe of a sinusoid in the window spans one bin of the unpadded signal on each side
+	int lobe = std::max(1, width / length);
+	double around = 0;
+	for (int k = std::max(1, peak - lobe); k <= std::min(nyquist, peak + lobe); k++)
+		around += power[k];
+
+	result.bpm = (float)(peak * _fps / width * 60);
+	result.confidence = (float)(around / total);
+
+	return result;
+}
+
+void WelchEstimator::init(int _segment_length, double _fps, double _low_freq, double _high_freq, int _averaged,
+						  double _resolution_bpm) {
+	if (_segment_length < 4 || _averaged < 1) {
+		perror("Segment length should be larger than 3 and at least one segment should be averaged");
+		return;
+	}
+
+	length_ = _segment_length;
+	hop_ = length_ / 2;
+	fps_ = _fps;
+	low_freq_ = _low_freq;
+	high_freq_ = _high_freq;
+	averaged_ = _averaged;
+
+	// the segment is zero padded to reach the resolution before the interpolation
+	width_ = cv::getOptimalDFTSize(std::max(length_, cvCeil(_fps * 60 / _resolution_bpm)));
+	int nyquist = width_ / 2;
+	kl_ = std::max(1, cvCeil(_low_freq * width_ / _fps));
+	kh_ = std::min(nyquist, cvFloor(_high_freq * width_ / _fps));
+	if (kl_ > kh_) {
+		kl_ = kh_ = std::min(nyquist, std::max(1, cvRound((_low_freq + _high_freq) / 2 * width_ / _fps)));
+	}
+
+	hann_.resize(length_);
+	for (int t = 0; t < length_; t++) {
+		hann_[t] = (float)(0.5 - 0.5 * std::cos(2 * CV_PI * t / (length_ - 1)));
+	}
+
+	reset();
+}
+
+void WelchEstimator::reset() {
+	samples_.assign(length_, 0.f);
+	ordered_.resize(length_);
+	head_ = 0;
+	until_segment_ = length_;
+
+	power_ = cv::Mat::zeros(averaged_, width_ / 2 + 1, CV_64FC1);
+	power_sum_ = cv::Mat::zeros(1, width_ / 2 + 1, CV_64FC1);
+	power_head_ = 0;
+
+	heart_rate_ = HeartRate();
+	stats_ = WelchStats();
+}
+
+HeartRate WelchEstimator::push(float sample) {
+	if (length_ == 0) {
+		perror("The estimator should be initialized before pushing samples");
+		return heart_rate_;
+	}
+
+	samples_[head_] = sample;
+	head_ = (head_ + 1) % length_;
+
+	// one segment per hop, the other samples are only written to the ring
+	if (--until_segment_ > 0)
+		return heart_rate_;
+
+	for (int t = 0; t < length_; t++) {
+		ordered_[t] = samples_[(head_ + t) % length_];
+	}
+	accumulate(ordered_.data(), stats_.segments == 0 ? length_ : hop_);
+	until_segment_ = hop_;
+
+	return heart_rate_;
+}
+
+HeartRate WelchEstimator::push_segment(const std::vector<float> &segment, int new_samples) {
+	if (length_ == 0 || (int)segment.size() != length_) {
+		perror("The segment should have the length of the estimator");
+		return heart_rate_;
+	}
+
+	if (new_samples < 0)
+		new_samples = stats_.segments == 0 ? length_ : hop_;
+	accumulate(segment.data(), new_samples);
+
+	return heart_rate_;
+}
+
+void WelchEstimator::accumulate(const float *segment, int new_samples) {
+	double mean = 0;
+	for (int t = 0; t < length_; t++)
+		mean += segment[t];
+	mean /= length_;
+
+	// the windowed segment without its mean, zero padded
+	padded_.create(1, width_, CV_32FC1);
+	padded_.setTo(cv::Scalar::all(0));
+	float *padded = padded_.ptr<float>();
+	for (int t = 0; t < length_; t++)
+		padded[t] = (float)((segment[t] - mean) * hann_[t]);
+
+	cv::dft(padded_, spectrum_, cv::DFT_COMPLEX_OUTPUT);
+
+	// the power of the segment replaces the oldest segment of the sum
+	int nyquist = width_ / 2;
+	const cv::Vec2f *bins = spectrum_.ptr<cv::Vec2f>();
+	double *power = power_.ptr<double>(power_head_);
+	for (int k = 1; k <= nyquist; k++)
+		power[k] = (double)bins[k][0] * bins[k][0] + (double)bins[k][1] * bins[k][1];
+	power_head_ = (power_head_ + 1) % averaged_;
+	cv::reduce(power_, power_sum_, 0, cv::REDUCE_SUM);
+
+	stats_.segments++;
+	stats_.samples += new_samples;
+
+	const double *sum = power_sum_.ptr<double>();
+	double total = 0;
+	for (int k = 1; k <= nyquist; k++)
+		total += sum[k];
+	if (total <= 0)
+		return;
+
+	int peak = kl_;
+	for (int k = kl_ + 1; k <= kh_; k++) {
+		if (sum[k] > sum[peak])
+			peak = k;
+	}
+
+	// the vertex of the parabola through the log power of the peak and its neighbours
+	double delta = 0;
+	if (peak > 1 && peak < nyquist && sum[peak - 1] > 0 && sum[peak + 1] > 0) {
+		double a = std::log(sum[peak - 1]);
+		double b = std::log(sum[peak]);
+		double c = std::log(sum[peak + 1]);
+		double denom = a - 2 * b + c;
+		if (denom < 0)
+			delta = std::max(-0.5, std::min(0.5, 0.5 * (a - c) / denom));
+	}
+
+	// the main lobe of the hann window spans two bins of the segment on each side
+	int lobe = std::max(1, 2 * width_ / length_);
+	double around = 0;
+	for (int k = std::max(1, peak - lobe); k <= std::min(nyquist, peak + lobe); k++)
+		around += sum[k];
+
+	heart_rate_.bpm = (float)((peak + delta) * fps_ / width_ * 60);
+	heart_rate_.confidence = (float)(around / total);
+
+	if (stats_.first_estimate < 0) {
+		stats_.first_estimate = stats_.samples;
+		stats_.first_estimate_seconds = stats_.samples / fps_;
+	}
+}
@@ -0,0 +1,143 @@
+#ifndef HEART_RATE_H
+#define HEART_RATE_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+
+/**
+ * the heart rate of a window of frames
+ */
+struct HeartRate {
+    float bpm = 0.f;            // beats per minute, 0 if there is no estimation
+    float confidence = 0.f;     // the part of the signal power around the peak, between 0 and 1
+};
+
+
+class HeartRateEstimator {
+public:
+    HeartRateEstimator() {}
+    ~HeartRateEstimator() {}
+
+    /**
+     * estimate() is used to locate the spectral peak of a signal between low_freq and high_freq,
+     * the signal is zero padded so that the peak is located to about resolution_bpm
+     *
+     * @param signal         : the time series, such as the spatial mean of the face in every frame
+     * @param fps            : the frame per second of the video
+     * @param low_freq       : the low frequence cut-off of the heart rate
+     * @param high_freq      : the high frequence cut-off of the heart rate
+     * @param resolution_bpm : the step of the frequency grid in beats per minute
+     * @return               : the heart rate and the confidence of it
+     */
+    HeartRate estimate(const std::vector<float> &signal, double fps, double low_freq, double high_freq,
+                       double resolution_bpm = 1.0);
+
+private:
+    //the zero padded signal and its spectrum are kept for the same length
+    cv::Mat padded_;
+    cv::Mat spectrum_;
+};
+
+
+/**
+ * the statistics of a WelchEstimator since the last reset
+ */
+struct WelchStats {
+    int samples = 0;                    // the samples covered by the segments
+    int segments = 0;                   // the segments accumulated
+    int first_estimate = -1;            // the samples before the first estimation, -1 if there is no estimation yet
+    double first_estimate_seconds = -1; // the same time in seconds
+};
+
+
+/**
+ * WelchEstimator is used to estimate the heart rate from the power spectrum averaged over overlapped segments.
+ * A segment is windowed by hann and transformed once, when hop samples have arrived since the last one, and the
+ * power spectrum is summed over the last segments. The peak is refined between the bins by
+ * a parabola through the log power, so a short segment still gives a fine heart rate.
+ */
+class WelchEstimator {
+public:
+    WelchEstimator() {}
+    ~WelchEstimator() {}
+
+    /**
+     * init() is used to set the segment and the band, the estimator is reset
+     *
+     * @param segment_length : the length of a segment, the hop between the segments is half of it
+     * @param fps            : the frame per second of the video
+     * @param low_freq       : the low frequence cut-off of the heart rate
+     * @param high_freq      : the high frequence cut-off of the heart rate
+     * @param averaged       : the number of the last segments averaged
+     * @param resolution_bpm : the step of the frequency grid in beats per minute before the interpolation
+     */
+    void init(int segment_length, double fps, double low_freq, double high_freq, int averaged = 8,
+              double resolution_bpm = 2.0);
+
+    /**
+     * push() is used to push one sample of the signal, a segment is accumulated every hop samples
+     *
+     * @param sample         : the newest sample
+     * @return               : the heart rate of the accumulated segments
+     */
+    HeartRate push(float sample);
+
+    /**
+     * push_segment() is used to accumulate a segment computed outside, such as the window of a SignalExtractor
+     *
+     * @param segment        : the segment in time order, which has the length of the segment
+     * @param new_samples    : the samples since the last segment, -1 for the length of the first segment and
+     *                         the hop after it
+     * @return               : the heart rate of the accumulated segments
+     */
+    HeartRate push_segment(const std::vector<float> &segment, int new_samples = -1);
+
+    /**
+     * reset() is used to drop the samples and the segments, the settings of init() are kept
+     */
+    void reset();
+
+    HeartRate heart_rate() const { return heart_rate_; }
+    const WelchStats &stats() const { return stats_; }
+    int hop() const { return hop_; }
+    int length() const { return length_; }
+
+private:
+    /**
+     * accumulate() is used to add the band power of a segment to the running sum and find the peak
+     */
+    void accumulate(const float *segment, int new_samples);
+
+    //param for the segment
+    int length_ = 0;
+    int hop_ = 0;
+    double fps_ = 30;
+    double low_freq_ = 0.7;
+    double high_freq_ = 4.0;
+    int averaged_ = 8;
+
+    //the padded width of the dft and the bins of the band
+    int width_ = 0;
+    int kl_ = 0, kh_ = 0;
+    std::vector<float> hann_;
+
+    //the ring of the samples
+    std::vector<float> samples_;
+    std::vector<float> ordered_;
+    int head_ = 0;
+    int until_segment_ = 0;
+
+    //the power spectrum of the last segments up to the nyquist bin, one row per segment, and their sum
+    cv::Mat power_;
+    cv::Mat power_sum_;
+    int power_head_ = 0;
+
+    cv::Mat padded_;
+    cv::Mat spectrum_;
+
+    HeartRate heart_rate_;
+    WelchStats stats_;
+};
+
+#endif //HEART_RATE_H
@@ -0,0 +1,213 @@
+#include "multi_face.h"
+#include <cfloat>
+
+void MultiFaceEngine::init(int _max_faces, int _window_length, int _fps, double _low_freq, double _high_freq,
+						   PulseMethod _method, double _resolution_bpm) {
+	if (_max_faces < 1 || _window_length < 2) {
+		perror("The engine should keep at least one face and two frames");
+		return;
+	}
+
+	max_faces_ = _max_faces;
+	window_ = _window_length;
+	fps_ = _fps;
+	low_freq_ = _low_freq;
+	high_freq_ = _high_freq;
+	resolution_bpm_ = _resolution_bpm;
+	method_ = _method;
+
+	ring_ = cv::Mat::zeros(window_, 3 * max_faces_, CV_32FC1);
+	counts_.assign(max_faces_, 0);
+	head_ = 0;
+	faces_ = 0;
+
+	band_filter_.plan(window_, low_freq_, high_freq_, fps_);
+
+	// the frequency grid between the cut-offs, the same grid as the zero padded dft of HeartRateEstimator
+	bins_ = std::max(1, cvFloor((high_freq_ - low_freq_) * 60 / resolution_bpm_) + 1);
+	basis_.create(window_, 2 * bins_, CV_32FC1);
+	for (int t = 0; t < window_; t++) {
+		float *basis = basis_.ptr<float>(t);
+		for (int b = 0; b < bins_; b++) {
+			double phase = 2 * CV_PI * (low_freq_ + b * resolution_bpm_ / 60) * t / fps_;
+			basis[2 * b] = (float)std::cos(phase);
+			basis[2 * b + 1] = (float)-std::sin(phase);
+		}
+	}
+
+	// the main lobe of a sinusoid in the window spans one bin of the window on each side
+	lobe_ = std::max(1, cvRound(fps_ * 60.0 / window_ / resolution_bpm_));
+}
+
+void MultiFaceEngine::push(const cv::Mat &frame, const std::vector<cv::Rect> &faces) {
+	if (window_ < 2) {
+		perror("The engine should be initialized before pushing frames");
+		return;
+	}
+
+	int count = std::min((int)faces.size(), max_faces_);
+	cv::Rect whole(0, 0, frame.cols, frame.rows);
+	float *slot = ring_.ptr<float>(head_);
+
+	// one reduction per face, the faces write different columns of the slot
+	cv::parallel_for_(cv::Range(0, count), [&](const cv::Range &range) {
+		for (int i = range.start; i < range.end; i++) {
+			cv::Rect region = faces[i] & whole;
+			if (region.area() == 0) {
+				// the window is sampled at the frame rate, so a face out of the frame holds its last color
+				if (counts_[i] > 0) {
+					const float *last = ring_.ptr<float>((head_ + window_ - 1) % window_);
+					for (int c = 0; c < 3; c++)
+						slot[c * max_faces_ + i] = last[c * max_faces_ + i];
+					counts_[i] = std::min(counts_[i] + 1, window_);
+				}
+				continue;
+			}
+
+			// the frame is in BGR order
+			cv::Scalar mean = cv::mean(frame(region));
+			float color[3] = {(float)mean[2], (float)mean[1], (float)mean[0]};
+
+			if (counts_[i] == 0) {
+				// a new face fills the window with its first color, so the unfilled part of it is flat
+				for (int t = 0; t < window_; t++) {
+					float *line = ring_.ptr<float>(t);
+					for (int c = 0; c < 3; c++)
+						line[c * max_faces_ + i] = color[c];
+				}
+			} else {
+				for (int c = 0; c < 3; c++)
+					slot[c * max_faces_ + i] = color[c];
+			}
+			counts_[i] = std::min(counts_[i] + 1, window_);
+		}
+	});
+
+	for (int i = count; i < max_faces_; i++) {
+		counts_[i] = 0;
+	}
+
+	faces_ = count;
+	head_ = (head_ + 1) % window_;
+}
+
+void MultiFaceEngine::estimate(std::vector<HeartRate> &rates) {
+	rates.assign(faces_, HeartRate());
+	if (faces_ == 0)
+		return;
+
+	// only the faces with at least half of the window are estimated, so the cost follows the faces, not the ring
+	active_.clear();
+	for (int i = 0; i < faces_; i++) {
+		if (counts_[i] * 2 >= window_)
+			active_.push_back(i);
+	}
+	int faces = (int)active_.size();
+	if (faces == 0)
+		return;
+
+	// the slots of the active faces in time order, the head slot is the oldest one
+	ordered_.create(window_, 3 * faces, CV_32FC1);
+	for (int t = 0; t < window_; t++) {
+		const float *line = ring_.ptr<float>((head_ + t) % window_);
+		float *out = ordered_.ptr<float>(t);
+		for (int c = 0; c < 3; c++)
+			for (int k = 0; k < faces; k++)
+				out[c * faces + k] = line[c * max_faces_ + active_[k]];
+	}
+
+	// the color of every face divided by its mean, so the pulse does not depend on the brightness of the skin
+	cv::reduce(ordered_, mean_, 0, cv::REDUCE_AVG);
+	float *scale = mean_.ptr<float>();
+	for (int j = 0; j < 3 * faces; j++) {
+		scale[j] = scale[j] > FLT_EPSILON ? 1.f / scale[j] : 0.f;
+	}
+	for (int t = 0; t < window_; t++) {
+		float *line = ordered_.ptr<float>(t);
+		for (int j = 0; j < 3 * faces; j++)
+			line[j] *= scale[j];
+	}
+
+	if (method_ == GREEN_PULSE) {
+		ordered_.colRange(faces, 2 * faces).convertTo(pulse_, CV_32FC1, 1, -1);
+		band_filter_.applyInPlace(pulse_);
+	} else {
+		// the chrominance signals of all the faces, the X plane and then the Y plane
+		chrom_.create(window_, 2 * faces, CV_32FC1);
+		for (int t = 0; t < window_; t++) {
+			const float *r = ordered_.ptr<float>(t);
+			const float *g = r + faces;
+			const float *b = g + faces;
+			float *x = chrom_.ptr<float>(t);
+			float *y = x + faces;
+			for (int i = 0; i < faces; i++) {
+				x[i] = 3 * r[i] - 2 * g[i];
+				y[i] = 1.5f * r[i] + g[i] - 1.5f * b[i];
+			}
+		}
+
+		band_filter_.applyInPlace(chrom_);
+
+		// the ratio of the deviations of X and Y of every face
+		std::vector<double> sumX(faces, 0.0), sqX(faces, 0.0), sumY(faces, 0.0), sqY(faces, 0.0);
+		for (int t = 0; t < window_; t++) {
+			const float *x = chrom_.ptr<float>(t);
+			const float *y = x + faces;
+			for (int i = 0; i < faces; i++) {
+				sumX[i] += x[i];
+				sqX[i] += x[i] * x[i];
+				sumY[i] += y[i];
+				sqY[i] += y[i] * y[i];
+			}
+		}
+
+		std::vector<float> alpha(faces);
+		for (int i = 0; i < faces; i++) {
+			double varX = sqX[i] / window_ - (sumX[i] / window_) * (sumX[i] / window_);
+			double varY = sqY[i] / window_ - (sumY[i] / window_) * (sumY[i] / window_);
+			alpha[i] = varY > DBL_EPSILON ? (float)std::sqrt(std::max(0.0, varX) / varY) : 0.f;
+		}
+
+		pulse_.create(window_, faces, CV_32FC1);
+		for (int t = 0; t < window_; t++) {
+			const float *x = chrom_.ptr<float>(t);
+			const float *y = x + faces;
+			float *p = pulse_.ptr<float>(t);
+			for (int i = 0; i < faces; i++)
+				p[i] = x[i] - alpha[i] * y[i];
+		}
+	}
+
+	// the frequency grid of all the faces, (2 * bins) * faces
+	cv::gemm(basis_, pulse_, 1, cv::noArray(), 0, spectrum_, cv::GEMM_1_T);
+
+	std::vector<double> power(bins_);
+	for (int k = 0; k < faces; k++) {
+		double total = 0;
+		int peak = 0;
+		for (int b = 0; b < bins_; b++) {
+			double re = spectrum_.at<float>(2 * b, k);
+			double im = spectrum_.at<float>(2 * b + 1, k);
+			power[b] = re * re + im * im;
+			total += power[b];
+			if (power[b] > power[peak])
+				peak = b;
+		}
+		if (total <= 0)
+			continue;
+
+		// the signal is band-passed, so the power of the grid is the power of the signal
+		double around = 0;
+		for (int b = std::max(0, peak - lobe_); b <= std::min(bins_ - 1, peak + lobe_); b++)
+			around += power[b];
+
+		HeartRate &rate = rates[active_[k]];
+		rate.bpm = (float)(low_freq_ * 60 + peak * resolution_bpm_);
+		rate.confidence = (float)(around / total);
+	}
+}
+
+void MultiFaceEngine::reset_face(int face) {
+	if (face >= 0 && face < max_faces_)
+		counts_[face] = 0;
+}
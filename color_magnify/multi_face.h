@@ -0,0 +1,100 @@
+#ifndef MULTI_FACE_H
+#define MULTI_FACE_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "band_filter.h"
+#include "heart_rate.h"
+
+
+/**
+ * MultiFaceEngine is used to estimate the heart rate of all the tracked faces of a video together.
+ * The mean color of every face is kept in one time-major ring, a slot holds the R plane of all the faces,
+ * then the G plane and the B plane, so a frame writes one line and the faces are filtered and
+ * transformed by the same gemm instead of one estimation per face.
+ */
+class MultiFaceEngine {
+public:
+    /**
+     * the projection of the mean color to the pulse signal
+     */
+    enum PulseMethod {
+        GREEN_PULSE,            // the green channel normalized by its mean
+        CHROM_PULSE             // X - std(X) / std(Y) * Y of the chrominance signals, as ChromExtractor
+    };
+
+    MultiFaceEngine() {}
+    ~MultiFaceEngine() {}
+
+    /**
+     * init() is used to allocate the ring and precompute the basis of the filter and the spectrum
+     *
+     * @param max_faces      : the number of faces kept in the ring
+     * @param window_length  : the number of frames in the window
+     * @param fps            : the frame per second of the video
+     * @param low_freq       : the low frequence cut-off of the heart rate
+     * @param high_freq      : the high frequence cut-off of the heart rate
+     * @param method         : the projection of the mean color to the pulse signal
+     * @param resolution_bpm : the step of the frequency grid in beats per minute
+     */
+    void init(int max_faces, int window_length, int fps = 30, double low_freq = 0.7, double high_freq = 4.0,
+              PulseMethod method = CHROM_PULSE, double resolution_bpm = 1.0);
+
+    /**
+     * push() is used to push the mean color of every face in one frame, the i-th face is kept in the i-th place.
+     * A face with an empty region, or out of the frame, holds its last color as the extractors of one face do.
+     * A face beyond the regions is dropped and starts again when it comes back
+     *
+     * @param frame          : the input frame, which is a CV_8UC3 format in BGR order
+     * @param faces          : the face regions in the frame
+     */
+    void push(const cv::Mat &frame, const std::vector<cv::Rect> &faces);
+
+    /**
+     * estimate() is used to estimate the heart rate of all the faces in one batch
+     *
+     * @param rates          : output the heart rate of every face of the last push, a face with less than
+     *                         half of the window has no estimation
+     */
+    void estimate(std::vector<HeartRate> &rates);
+
+    /**
+     * reset_face() is used to drop the history of one face, for example when the tracker is moved to another face
+     */
+    void reset_face(int face);
+
+    int max_faces() const { return max_faces_; }
+    int count(int face) const { return counts_[face]; }
+
+private:
+    //param for the window
+    int max_faces_ = 0;
+    int window_ = 0;
+    int fps_ = 30;
+    double low_freq_ = 0.7;
+    double high_freq_ = 4.0;
+    double resolution_bpm_ = 1.0;
+    PulseMethod method_ = CHROM_PULSE;
+
+    //window * (3 * max_faces), the R, G and B planes of every slot
+    cv::Mat ring_;
+    std::vector<int> counts_;
+    int head_ = 0;
+    int faces_ = 0;
+
+    //variable for the estimation, one column per active face
+    std::vector<int> active_;
+    cv::Mat ordered_;
+    cv::Mat mean_;
+    cv::Mat chrom_;
+    cv::Mat pulse_;
+    cv::Mat spectrum_;
+    BandFilterBank band_filter_;
+
+    //window * (2 * bins), the cos and -sin of the frequency grid between the cut-offs
+    cv::Mat basis_;
+    int bins_ = 0;
+    int lobe_ = 1;
+};
+
+#endif //MULTI_FACE_H
@@ -0,0 +1,108 @@
+#include "pixel_history.h"
+
+// the planes are padded to a multiple of the cache line, 16 floats
+static const int kLineFloats = 16;
+
+void PixelHistory::create(cv::Size _frame_size, int _channels, int _capacity) {
+	size_ = _frame_size;
+	channels_ = _channels;
+	capacity_ = _capacity;
+	stride_ = (int)cv::alignSize(_frame_size.area(), kLineFloats);
+
+	data_ = cv::Mat::zeros(_capacity, _channels * stride_, CV_32FC1);
+	head_ = 0;
+	count_ = 0;
+}
+
+void PixelHistory::clear() {
+	data_.setTo(cv::Scalar::all(0));
+	head_ = 0;
+	count_ = 0;
+}
+
+void PixelHistory::push(const cv::Mat &_frame) {
+	// write the separate planes directly to the newest slot
+	std::vector<cv::Mat> planes;
+	for (int c = 0; c < channels_; c++) {
+		planes.push_back(plane(head_, c));
+	}
+	cv::split(_frame, planes);
+
+	advance();
+}
+
+void PixelHistory::advance() {
+	head_ = (head_ + 1) % capacity_;
+	count_ = std::min(count_ + 1, capacity_);
+}
+
+cv::Mat PixelHistory::plane(int _slot, int _channel) const {
+	float *data = const_cast<float *>(data_.ptr<float>(_slot)) + _channel * stride_;
+	return cv::Mat(size_, CV_32FC1, data);
+}
+
+cv::Mat PixelHistory::slot(int _slot) const {
+	return data_.row(_slot);
+}
+
+cv::Mat PixelHistory::channel(int _channel) const {
+	return data_.colRange(_channel * stride_, _channel * stride_ + size_.area());
+}
+
+void PixelHistory::frame(int _slot, cv::Mat &dst, double alpha, double beta) const {
+	frame(slot(_slot), dst, alpha, beta);
+}
+
+void PixelHistory::frame(const cv::Mat &planar, cv::Mat &dst, double alpha, double beta) const {
+	dst.create(size_, CV_MAKETYPE(CV_32F, channels_));
+
+	const float *src = planar.ptr<float>();
+	float *out = dst.ptr<float>();
+	int pixels = size_.area();
+
+	for (int c = 0; c < channels_; c++) {
+		const float *line = src + c * stride_;
+		for (int p = 0; p < pixels; p++) {
+			out[p * channels_ + c] = (float)(line[p] * alpha + beta);
+		}
+	}
+}
+
+void PixelHistory::concat(cv::Mat &dst, double alpha, double beta) const {
+	int pixels = size_.area();
+	dst.create(pixels, count_, CV_MAKETYPE(CV_32F, channels_));
+
+	for (int t = 0; t < count_; t++) {
+		const float *src = data_.ptr<float>(slotOf(t));
+		for (int c = 0; c < channels_; c++) {
+			const float *line = src + c * stride_;
+			for (int p = 0; p < pixels; p++) {
+				dst.ptr<float>(p)[t * channels_ + c] = (float)(line[p] * alpha + beta);
+			}
+		}
+	}
+}
+
+void PixelHistory::minMax(double &minVal, double &maxVal) const {
+	minVal = DBL_MAX;
+	maxVal = -DBL_MAX;
+	for (int t = 0; t < count_; t++) {
+		double slotMin, slotMax;
+		minMax(slot(slotOf(t)), slotMin, slotMax);
+		minVal = std::min(minVal, slotMin);
+		maxVal = std::max(maxVal, slotMax);
+	}
+}
+
+void PixelHistory::minMax(const cv::Mat &planar, double &minVal, double &maxVal) const {
+	minVal = DBL_MAX;
+	maxVal = -DBL_MAX;
+	int pixels = size_.area();
+	for (int c = 0; c < channels_; c++) {
+		cv::Mat line(1, pixels, CV_32FC1, const_cast<float *>(planar.ptr<float>()) + c * stride_);
+		double lineMin, lineMax;
+		cv::minMaxLoc(line, &lineMin, &lineMax);
+		minVal = std::min(minVal, lineMin);
+		maxVal = std::max(maxVal, lineMax);
+	}
+}
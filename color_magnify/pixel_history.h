@@ -0,0 +1,121 @@
+#ifndef PIXEL_HISTORY_H
+#define PIXEL_HISTORY_H
+
+#include <opencv2/opencv.hpp>
+
+
+/**
+ * PixelHistory is used to keep the down sampled frames of a window in a time-major, channel-planar buffer.
+ * Each slot holds one frame, the planes of a slot are padded to the cache line, so the time series of
+ * a block of pixels is read with one line per frame. The slots are used as a ring in the stream.
+ */
+class PixelHistory {
+public:
+    PixelHistory() {}
+    ~PixelHistory() {}
+
+    /**
+     * create() is used to allocate the buffer, all the slots are set to zero
+     *
+     * @param frame_size    : the size of the down sampled frame
+     * @param channels      : the channels of the frame
+     * @param capacity      : the number of slots, which is the length of the window
+     */
+    void create(cv::Size frame_size, int channels, int capacity);
+
+    /**
+     * clear() is used to set all the slots to zero and restart the ring
+     */
+    void clear();
+
+    /**
+     * push() is used to write a frame into the newest slot, the oldest frame is overwritten if the ring is full
+     *
+     * @param frame         : the down sampled frame, which is a CV_32FC3 format
+     */
+    void push(const cv::Mat &frame);
+
+    /**
+     * advance() is used to move the ring after the planes of head() are written directly
+     */
+    void advance();
+
+    /**
+     * plane() is used to get a channel of a slot, which is a CV_32FC1 view of the buffer
+     *
+     * @param slot          : the index of the slot
+     * @param channel       : the channel of the frame
+     * @return              : the view with the size of the frame
+     */
+    cv::Mat plane(int slot, int channel) const;
+
+    /**
+     * slot() is used to get all the planes of a slot, which is a 1 * (channels * stride) view of the buffer
+     *
+     * @param slot          : the index of the slot
+     * @return              : the view of the slot
+     */
+    cv::Mat slot(int slot) const;
+
+    /**
+     * channel() is used to get the time series of a channel, which is a capacity * pixels view of the buffer
+     *
+     * @param channel       : the channel of the frame
+     * @return              : the view with one row per slot
+     */
+    cv::Mat channel(int channel) const;
+
+    /**
+     * frame() is used to interleave the planes of a slot back to a frame, alpha * x + beta
+     *
+     * @param slot          : the index of the slot, or a 1 * (channels * stride) planar frame
+     * @param dst           : output the frame, which is a CV_32FC3 format
+     * @param alpha         : the scale factor
+     * @param beta          : the delta added to the scaled values
+     */
+    void frame(int slot, cv::Mat &dst, double alpha = 1, double beta = 0) const;
+    void frame(const cv::Mat &planar, cv::Mat &dst, double alpha = 1, double beta = 0) const;
+
+    /**
+     * concat() is used to write the frames in time order into a concatenated image, alpha * x + beta
+     *
+     * @param dst           : output the concatenated image with one column per frame, which is a CV_32FC3 format
+     * @param alpha         : the scale factor
+     * @param beta          : the delta added to the scaled values
+     */
+    void concat(cv::Mat &dst, double alpha = 1, double beta = 0) const;
+
+    /**
+     * minMax() is used to find the range of the filled slots, the padding of the planes is skipped
+     *
+     * @param minVal        : output the minimum value
+     * @param maxVal        : output the maximum value
+     */
+    void minMax(double &minVal, double &maxVal) const;
+    void minMax(const cv::Mat &planar, double &minVal, double &maxVal) const;
+
+    /**
+     * slotOf() is used to get the slot of the t-th frame in time order, the oldest frame is 0
+     */
+    int slotOf(int t) const { return (oldest() + t) % capacity_; }
+
+    int head() const { return head_; }
+    int oldest() const { return count_ < capacity_ ? 0 : head_; }
+    int count() const { return count_; }
+    int capacity() const { return capacity_; }
+    int channels() const { return channels_; }
+    int stride() const { return stride_; }
+    cv::Size size() const { return size_; }
+
+private:
+    //one row per slot, the planes of a slot are placed one after another
+    cv::Mat data_;
+    cv::Size size_;
+    int channels_ = 0;
+    int capacity_ = 0;
+    int stride_ = 0;
+    int head_ = 0;
+    int count_ = 0;
+};
+
+#endif //PIXEL_HISTORY_H
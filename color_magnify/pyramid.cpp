@@ -0,0 +1,181 @@
+/**
+ * cv::pyrDown filters with the 5-tap kernel k = [1 4 6 4 1] / 16 and keeps every second pixel, so
+ * `levels` of them are one filter K with step 2^levels,
+ *
+ * 		K(1)(d) = k(d),  K(l+1)(d) = sum k(n) * K(l)(d - 2^l * n)
+ *
+ * which has 4 * (2^levels - 1) + 1 taps. The separable kernel is applied to the rows of the input
+ * frame first, which keeps 1 / 2^levels of the columns, and then to the columns of this small buffer.
+ */
+
+#include "pyramid.h"
+
+namespace {
+
+const double kPyrKernel[5] = {1 / 16., 4 / 16., 6 / 16., 4 / 16., 1 / 16.};
+
+int reflect101(int p, int len) {
+	if (len == 1)
+		return 0;
+	while (p < 0 || p >= len) {
+		p = p < 0 ? -p : 2 * len - 2 - p;
+	}
+	return p;
+}
+
+std::vector<float> fusedKernel(int levels) {
+	std::vector<double> kernel(1, 1.0);
+	int radius = 0;
+
+	for (int l = 0; l < levels; l++) {
+		int step = 1 << l;
+		int next_radius = radius + 2 * step;
+		std::vector<double> next(2 * next_radius + 1, 0.0);
+		for (int n = -2; n <= 2; n++) {
+			for (int m = -radius; m <= radius; m++) {
+				next[m + step * n + next_radius] += kPyrKernel[n + 2] * kernel[m + radius];
+			}
+		}
+		kernel.swap(next);
+		radius = next_radius;
+	}
+
+	return std::vector<float>(kernel.begin(), kernel.end());
+}
+
+// offsets of the taps of every output pixel, the borders are reflected as BORDER_REFLECT_101
+std::vector<int> tapOffsets(int len, int dlen, int step, int taps, int scale) {
+	int radius = taps / 2;
+	std::vector<int> ofs((size_t)dlen * taps);
+	for (int x = 0; x < dlen; x++) {
+		for (int t = 0; t < taps; t++) {
+			ofs[x * taps + t] = reflect101(x * step + t - radius, len) * scale;
+		}
+	}
+	return ofs;
+}
+
+template<typename T>
+void decimateRows(const cv::Mat &src, cv::Mat &rows, const std::vector<float> &kernel,
+				  const std::vector<int> &xofs, const cv::Range &range) {
+	int cn = src.channels();
+	int taps = (int)kernel.size();
+	int dw = rows.cols / cn;
+
+	for (int y = range.start; y < range.end; y++) {
+		const T *s = src.ptr<T>(y);
+		float *d = rows.ptr<float>(y);
+
+		for (int x = 0; x < dw; x++) {
+			const int *ofs = &xofs[x * taps];
+			float acc[4] = {0, 0, 0, 0};
+			for (int t = 0; t < taps; t++) {
+				const T *p = s + ofs[t];
+				float k = kernel[t];
+				for (int c = 0; c < cn; c++)
+					acc[c] += k * p[c];
+			}
+			for (int c = 0; c < cn; c++)
+				d[x * cn + c] = acc[c];
+		}
+	}
+}
+
+void fusedPyrDown(const cv::Mat &_src, int levels, cv::Mat *dst, std::vector<cv::Mat> *planes) {
+	cv::Mat src = _src;
+	if (src.depth() != CV_8U && src.depth() != CV_32F)
+		src.convertTo(src, CV_32F);
+
+	int cn = src.channels();
+	CV_Assert(cn <= 4);
+
+	int step = 1 << levels;
+	cv::Size dsize = pyrDownSize(src.size(), levels);
+	auto kernel = fusedKernel(levels);
+	int taps = (int)kernel.size();
+
+	auto xofs = tapOffsets(src.cols, dsize.width, step, taps, cn);
+	auto yofs = tapOffsets(src.rows, dsize.height, step, taps, 1);
+
+	// rows of the input frame filtered and decimated horizontally
+	cv::Mat rows(src.rows, dsize.width * cn, CV_32FC1);
+	cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range &range) {
+		if (src.depth() == CV_8U)
+			decimateRows<uchar>(src, rows, kernel, xofs, range);
+		else
+			decimateRows<float>(src, rows, kernel, xofs, range);
+	});
+
+	if (dst)
+		dst->create(dsize, CV_MAKETYPE(CV_32F, cn));
+
+	// columns filtered and decimated, written to the interleaved frame or to the planes
+	cv::parallel_for_(cv::Range(0, dsize.height), [&](const cv::Range &range) {
+		std::vector<float> acc(rows.cols);
+		for (int y = range.start; y < range.end; y++) {
+			std::fill(acc.begin(), acc.end(), 0.f);
+			for (int t = 0; t < taps; t++) {
+				const float *r = rows.ptr<float>(yofs[y * taps + t]);
+				float k = kernel[t];
+				for (int i = 0; i < rows.cols; i++)
+					acc[i] += k * r[i];
+			}
+
+			if (dst) {
+				std::copy(acc.begin(), acc.end(), dst->ptr<float>(y));
+			} else {
+				for (int c = 0; c < cn; c++) {
+					float *d = (*planes)[c].ptr<float>(y);
+					for (int x = 0; x < dsize.width; x++)
+						d[x] = acc[x * cn + c];
+				}
+			}
+		}
+	});
+}
+
+}
+
+cv::Size pyrDownSize(cv::Size size, int levels) {
+	for (int l = 0; l < levels; l++) {
+		size = cv::Size((size.width + 1) / 2, (size.height + 1) / 2);
+	}
+	return size;
+}
+
+void pyrDownFused(const cv::Mat &src, cv::Mat &dst, int levels) {
+	fusedPyrDown(src, levels, &dst, nullptr);
+}
+
+void pyrDownFused(const cv::Mat &src, std::vector<cv::Mat> &planes, int levels) {
+	fusedPyrDown(src, levels, nullptr, &planes);
+}
+
+void pyrDownLevels(const cv::Mat &src, cv::Mat &dst, int levels, bool fused) {
+	if (fused) {
+		pyrDownFused(src, dst, levels);
+		return;
+	}
+
+	// the intermediate levels are kept in float, as they are rounded in CV_8U
+	cv::Mat result;
+	src.convertTo(result, CV_32F);
+	for (int l = 0; l < levels; l++) {
+		cv::Mat down;
+		cv::pyrDown(result, down);
+		result = std::move(down);
+	}
+	dst = result;
+}
+
+void pyrDownLevels(const cv::Mat &src, std::vector<cv::Mat> &planes, int levels, bool fused) {
+	if (fused) {
+		pyrDownFused(src, planes, levels);
+		return;
+	}
+
+	// the planes have the size of the level already, so they are written where they are
+	cv::Mat result;
+	pyrDownLevels(src, result, levels, false);
+	cv::split(result, planes);
+}
@@ -0,0 +1,60 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+
+/**
+ * pyrDownFused() is used to down sample a frame to the level-th level of the gaussian pyramid in one pass.
+ * The levels of cv::pyrDown are folded into one kernel, so the intermediate levels are never built
+ * and a CV_8U frame is read directly. The result is the same as calling cv::pyrDown level times within
+ * the float rounding, except the last one or two rows and columns where the border is reflected once.
+ *
+ * @param src           : the input frame, which is a CV_8UC3 or CV_32FC3 format
+ * @param dst           : output the down sampled frame, which is a CV_32FC3 format
+ * @param levels        : the pyramid level used for down sampling
+ */
+void pyrDownFused(const cv::Mat &src, cv::Mat &dst, int levels);
+
+/**
+ * pyrDownFused() is used to down sample a frame and write the channels into separate planes
+ *
+ * @param src           : the input frame, which is a CV_8UC3 or CV_32FC3 format
+ * @param planes        : the CV_32FC1 planes with the size of the down sampled frame, one per channel
+ * @param levels        : the pyramid level used for down sampling
+ */
+void pyrDownFused(const cv::Mat &src, std::vector<cv::Mat> &planes, int levels);
+
+/**
+ * pyrDownLevels() is used to down sample a frame to the level-th level of the gaussian pyramid by cv::pyrDown of
+ * every level on the float frame, or by pyrDownFused() if fused is set. The SIMD kernel of cv::pyrDown is the
+ * default, the fused kernel has 4 * (2^levels - 1) + 1 taps and is not faster than it in general
+ *
+ * @param src           : the input frame, which is a CV_8UC3 or CV_32FC3 format
+ * @param dst           : output the down sampled frame, which is a CV_32FC3 format
+ * @param levels        : the pyramid level used for down sampling
+ * @param fused         : down sample by pyrDownFused()
+ */
+void pyrDownLevels(const cv::Mat &src, cv::Mat &dst, int levels, bool fused = false);
+
+/**
+ * pyrDownLevels() is used to down sample a frame and write the channels into separate planes
+ *
+ * @param src           : the input frame, which is a CV_8UC3 or CV_32FC3 format
+ * @param planes        : the CV_32FC1 planes with the size of the down sampled frame, one per channel
+ * @param levels        : the pyramid level used for down sampling
+ * @param fused         : down sample by pyrDownFused()
+ */
+void pyrDownLevels(const cv::Mat &src, std::vector<cv::Mat> &planes, int levels, bool fused = false);
+
+/**
+ * pyrDownSize() is used to get the size of the level-th level of the gaussian pyramid
+ *
+ * @param size          : the size of the input frame
+ * @param levels        : the pyramid level used for down sampling
+ * @return              : the size of the down sampled frame
+ */
+cv::Size pyrDownSize(cv::Size size, int levels);
+
+#endif //PYRAMID_H
@@ -0,0 +1,206 @@
+#include "signal_extractor.h"
+#include <cfloat>
+
+MeanRGBExtractor::MeanRGBExtractor(int _window_length, int _fps, double _low_freq, double _high_freq)
+		: window_(_window_length), fps_(_fps), low_freq_(_low_freq), high_freq_(_high_freq) {
+	if (_window_length < 2) {
+		perror("Window length should be larger than 1");
+		window_ = 2;
+	}
+	means_ = cv::Mat::zeros(3, window_, CV_32FC1);
+}
+
+void MeanRGBExtractor::push(const cv::Mat &frame, const cv::Rect &face) {
+	cv::Rect whole(0, 0, frame.cols, frame.rows);
+	cv::Rect region = face.area() > 0 ? face & whole : whole;
+	if (region.area() == 0) {
+		// the window is sampled at the frame rate, so a frame without the face holds the last color
+		if (count_ == 0)
+			return;
+		int last = (head_ + window_ - 1) % window_;
+		for (int c = 0; c < 3; c++)
+			means_.at<float>(c, head_) = means_.at<float>(c, last);
+	} else {
+		// one reduction over the face, the frame is in BGR order
+		cv::Scalar mean = cv::mean(frame(region));
+		means_.at<float>(0, head_) = (float)mean[2];
+		means_.at<float>(1, head_) = (float)mean[1];
+		means_.at<float>(2, head_) = (float)mean[0];
+	}
+
+	head_ = (head_ + 1) % window_;
+	count_ = std::min(count_ + 1, window_);
+}
+
+HeartRate MeanRGBExtractor::heart_rate() {
+	if (!signal(series_))
+		return HeartRate();
+
+	return estimator_.estimate(series_, fps_, low_freq_, high_freq_);
+}
+
+bool MeanRGBExtractor::signal(std::vector<float> &series) {
+	if (count_ < 2)
+		return false;
+
+	// the mean color of the window in time order, the oldest frame first
+	int oldest = count_ < window_ ? 0 : head_;
+	ordered_.create(3, count_, CV_32FC1);
+	for (int c = 0; c < 3; c++) {
+		const float *src = means_.ptr<float>(c);
+		float *dst = ordered_.ptr<float>(c);
+		for (int t = 0; t < count_; t++) {
+			dst[t] = src[(oldest + t) % window_];
+		}
+	}
+
+	pulse(ordered_, signal_);
+	bandPass(signal_, filtered_);
+
+	series.assign(filtered_.ptr<float>(), filtered_.ptr<float>() + count_);
+	return true;
+}
+
+void MeanRGBExtractor::reset() {
+	means_.setTo(cv::Scalar::all(0));
+	head_ = 0;
+	count_ = 0;
+}
+
+void MeanRGBExtractor::bandPass(const cv::Mat &src, cv::Mat &dst) {
+	band_filter_.plan(src.cols, low_freq_, high_freq_, fps_);
+	band_filter_.apply(src, dst);
+}
+
+namespace {
+
+// the color of every row divided by its mean, so the pulse does not depend on the brightness of the skin
+void normalizeRows(const cv::Mat &src, cv::Mat &dst) {
+	dst.create(src.size(), CV_32FC1);
+	for (int c = 0; c < src.rows; c++) {
+		double mean = cv::mean(src.row(c))[0];
+		double scale = mean > DBL_EPSILON ? 1.0 / mean : 0.0;
+		src.row(c).convertTo(dst.row(c), CV_32FC1, scale);
+	}
+}
+
+}
+
+void GreenExtractor::pulse(const cv::Mat &rgb, cv::Mat &signal) {
+	cv::Mat normalized;
+	normalizeRows(rgb.row(1), normalized);
+	normalized.convertTo(signal, CV_32FC1, 1, -1);
+}
+
+void ChromExtractor::pulse(const cv::Mat &rgb, cv::Mat &signal) {
+	cv::Mat normalized;
+	normalizeRows(rgb, normalized);
+
+	// the chrominance signals, X in the first row and Y in the second row
+	int length = rgb.cols;
+	chrom_.create(2, length, CV_32FC1);
+	const float *r = normalized.ptr<float>(0);
+	const float *g = normalized.ptr<float>(1);
+	const float *b = normalized.ptr<float>(2);
+	float *x = chrom_.ptr<float>(0);
+	float *y = chrom_.ptr<float>(1);
+	for (int t = 0; t < length; t++) {
+		x[t] = 3 * r[t] - 2 * g[t];
+		y[t] = 1.5f * r[t] + g[t] - 1.5f * b[t];
+	}
+
+	bandPass(chrom_, chrom_filtered_);
+
+	// the specular part is the same in X and Y, so it is cancelled by their ratio of the deviations
+	cv::Scalar meanX, stdX, meanY, stdY;
+	cv::meanStdDev(chrom_filtered_.row(0), meanX, stdX);
+	cv::meanStdDev(chrom_filtered_.row(1), meanY, stdY);
+	double alpha = stdY[0] > DBL_EPSILON ? stdX[0] / stdY[0] : 0.0;
+
+	cv::addWeighted(chrom_filtered_.row(0), 1, chrom_filtered_.row(1), -alpha, 0, signal);
+}
+
+void PosExtractor::pulse(const cv::Mat &rgb, cv::Mat &signal) {
+	int length = rgb.cols;
+
+	// the short window is 1.6 seconds, which holds at least one beat of the lowest heart rate
+	int window = std::min(length, cvCeil(1.6 * fps_));
+
+	signal = cv::Mat::zeros(1, length, CV_32FC1);
+	float *h = signal.ptr<float>();
+
+	std::vector<float> s1(window), s2(window);
+	for (int n = 0; n + window <= length; n++) {
+		// the color normalized by the mean of the short window
+		double mean[3];
+		for (int c = 0; c < 3; c++) {
+			mean[c] = cv::mean(rgb.row(c).colRange(n, n + window))[0];
+			mean[c] = mean[c] > DBL_EPSILON ? 1.0 / mean[c] : 0.0;
+		}
+
+		const float *r = rgb.ptr<float>(0) + n;
+		const float *g = rgb.ptr<float>(1) + n;
+		const float *b = rgb.ptr<float>(2) + n;
+
+		// projected on the plane orthogonal to the skin tone
+		double sum1 = 0, sum2 = 0, sq1 = 0, sq2 = 0;
+		for (int t = 0; t < window; t++) {
+			float rn = (float)(r[t] * mean[0]);
+			float gn = (float)(g[t] * mean[1]);
+			float bn = (float)(b[t] * mean[2]);
+			s1[t] = gn - bn;
+			s2[t] = gn + bn - 2 * rn;
+			sum1 += s1[t];
+			sum2 += s2[t];
+			sq1 += s1[t] * s1[t];
+			sq2 += s2[t] * s2[t];
+		}
+
+		double std1 = std::sqrt(std::max(0.0, sq1 / window - (sum1 / window) * (sum1 / window)));
+		double std2 = std::sqrt(std::max(0.0, sq2 / window - (sum2 / window) * (sum2 / window)));
+		double alpha = std2 > DBL_EPSILON ? std1 / std2 : 0.0;
+
+		// overlap-add the zero mean pulse of the short window
+		double mean_h = (sum1 + alpha * sum2) / window;
+		for (int t = 0; t < window; t++) {
+			h[n + t] += (float)(s1[t] + alpha * s2[t] - mean_h);
+		}
+	}
+}
+
+EvmExtractor::EvmExtractor(int _window_length, int _fps, double _low_freq, double _high_freq, int _pyramid_level) {
+	color_magnify_.set_stream(_window_length, _fps, 50.f, _low_freq, _high_freq, _pyramid_level);
+}
+
+void EvmExtractor::push(const cv::Mat &frame, const cv::Rect &face) {
+	heart_rate_ = color_magnify_.push_heart_rate(frame, face);
+}
+
+bool EvmExtractor::signal(std::vector<float> &series) {
+	const cv::Mat &filtered = color_magnify_.get_heart_signal();
+	if (filtered.cols < 2)
+		return false;
+
+	series.assign(filtered.ptr<float>(), filtered.ptr<float>() + filtered.cols);
+	return true;
+}
+
+void EvmExtractor::reset() {
+	color_magnify_.reset_stream();
+	heart_rate_ = HeartRate();
+}
+
+std::shared_ptr<SignalExtractor> createSignalExtractor(const std::string &name, int window_length, int fps,
+													   double low_freq, double high_freq) {
+	if (name == "green")
+		return std::make_shared<GreenExtractor>(window_length, fps, low_freq, high_freq);
+	if (name == "chrom")
+		return std::make_shared<ChromExtractor>(window_length, fps, low_freq, high_freq);
+	if (name == "pos")
+		return std::make_shared<PosExtractor>(window_length, fps, low_freq, high_freq);
+	if (name == "evm")
+		return std::make_shared<EvmExtractor>(window_length, fps, low_freq, high_freq);
+
+	perror(("Unknown signal extractor " + name).c_str());
+	return nullptr;
+}
@@ -0,0 +1,196 @@
+#ifndef SIGNAL_EXTRACTOR_H
+#define SIGNAL_EXTRACTOR_H
+
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+#include "band_filter.h"
+#include "heart_rate.h"
+#include "color_magnify.h"
+
+
+/**
+ * SignalExtractor is used to turn the frames of a tracked face into a pulse signal and its heart rate,
+ * the extractors could be switched at runtime by createSignalExtractor()
+ */
+class SignalExtractor {
+public:
+    SignalExtractor() {}
+    virtual ~SignalExtractor() {}
+
+    /**
+     * push() is used to push one frame of the face into the window
+     *
+     * @param frame         : the input frame, which is a CV_8UC3 format in BGR order
+     * @param face          : the face region in the frame, the whole frame is used if it is empty. A face out of
+     *                        the frame holds the last sample, so the window stays sampled at the frame rate
+     */
+    virtual void push(const cv::Mat &frame, const cv::Rect &face) = 0;
+
+    /**
+     * heart_rate() is used to estimate the heart rate of the frames in the window
+     *
+     * @return              : the heart rate and the confidence of it
+     */
+    virtual HeartRate heart_rate() = 0;
+
+    /**
+     * signal() is used to get the band-passed pulse signal of the window, such as a segment of WelchEstimator
+     *
+     * @param series        : output the pulse signal in time order, the oldest frame first
+     * @return              : false if there are not enough frames in the window
+     */
+    virtual bool signal(std::vector<float> &series) = 0;
+
+    /**
+     * reset() is used to drop the frames in the window, for example when the face is lost
+     */
+    virtual void reset() = 0;
+
+    virtual std::string name() const = 0;
+};
+
+
+/**
+ * MeanRGBExtractor is used to keep the mean color of the face in every frame, the frame costs one
+ * reduction over the face and the pulse is computed from the 3 * T signal of the window alone
+ */
+class MeanRGBExtractor : public SignalExtractor {
+public:
+    /**
+     * @param window_length : the number of frames in the window
+     * @param fps           : the frame per second of the video
+     * @param low_freq      : the low frequence cut-off of the heart rate
+     * @param high_freq     : the high frequence cut-off of the heart rate
+     */
+    MeanRGBExtractor(int window_length, int fps, double low_freq, double high_freq);
+    virtual ~MeanRGBExtractor() {}
+
+    void push(const cv::Mat &frame, const cv::Rect &face) override;
+    HeartRate heart_rate() override;
+    bool signal(std::vector<float> &series) override;
+    void reset() override;
+
+protected:
+    /**
+     * pulse() is used to combine the mean color of the window into one pulse signal
+     *
+     * @param rgb           : the mean color of every frame in time order, 3 * T, one row per channel in R, G, B order
+     * @param signal        : output the pulse signal, 1 * T
+     */
+    virtual void pulse(const cv::Mat &rgb, cv::Mat &signal) = 0;
+
+    /**
+     * bandPass() is used to filter the rows of a signal with the passband of the heart rate
+     */
+    void bandPass(const cv::Mat &src, cv::Mat &dst);
+
+    //param for the window
+    int window_ = 0;
+    int fps_ = 30;
+    double low_freq_ = 0.7;
+    double high_freq_ = 4.0;
+
+private:
+    //the mean color of every slot of the ring, 3 * window in R, G, B order
+    cv::Mat means_;
+    int head_ = 0;
+    int count_ = 0;
+
+    //variable for the estimation
+    cv::Mat ordered_;
+    cv::Mat signal_;
+    cv::Mat filtered_;
+    std::vector<float> series_;
+    BandFilterBank band_filter_;
+    HeartRateEstimator estimator_;
+};
+
+
+/**
+ * GreenExtractor uses the green channel normalized by its mean
+ */
+class GreenExtractor : public MeanRGBExtractor {
+public:
+    GreenExtractor(int window_length, int fps, double low_freq, double high_freq)
+        : MeanRGBExtractor(window_length, fps, low_freq, high_freq) {}
+
+    std::string name() const override { return "green"; }
+
+protected:
+    void pulse(const cv::Mat &rgb, cv::Mat &signal) override;
+};
+
+
+/**
+ * ChromExtractor projects the normalized color on the chrominance signals X = 3R - 2G and Y = 1.5R + G - 1.5B,
+ * the band-passed signals are combined as X - std(X) / std(Y) * Y, see de Haan and Jeanne, 2013
+ */
+class ChromExtractor : public MeanRGBExtractor {
+public:
+    ChromExtractor(int window_length, int fps, double low_freq, double high_freq)
+        : MeanRGBExtractor(window_length, fps, low_freq, high_freq) {}
+
+    std::string name() const override { return "chrom"; }
+
+protected:
+    void pulse(const cv::Mat &rgb, cv::Mat &signal) override;
+
+private:
+    cv::Mat chrom_;
+    cv::Mat chrom_filtered_;
+};
+
+
+/**
+ * PosExtractor projects the color normalized in short windows on the plane orthogonal to the skin tone,
+ * S1 = G - B and S2 = G + B - 2R, and overlap-adds S1 + std(S1) / std(S2) * S2, see Wang et al., 2017
+ */
+class PosExtractor : public MeanRGBExtractor {
+public:
+    PosExtractor(int window_length, int fps, double low_freq, double high_freq)
+        : MeanRGBExtractor(window_length, fps, low_freq, high_freq) {}
+
+    std::string name() const override { return "pos"; }
+
+protected:
+    void pulse(const cv::Mat &rgb, cv::Mat &signal) override;
+};
+
+
+/**
+ * EvmExtractor uses the gaussian pyramid of the whole frame as ColorMagnify does, which costs much more
+ * than the mean color but keeps the spatial filter of the magnification
+ */
+class EvmExtractor : public SignalExtractor {
+public:
+    EvmExtractor(int window_length, int fps, double low_freq, double high_freq, int pyramid_level = 4);
+
+    void push(const cv::Mat &frame, const cv::Rect &face) override;
+    HeartRate heart_rate() override { return heart_rate_; }
+    bool signal(std::vector<float> &series) override;
+    void reset() override;
+
+    std::string name() const override { return "evm"; }
+
+private:
+    ColorMagnify color_magnify_;
+    HeartRate heart_rate_;
+};
+
+
+/**
+ * createSignalExtractor() is used to create an extractor by its name
+ *
+ * @param name          : "green", "chrom", "pos" or "evm"
+ * @param window_length : the number of frames in the window
+ * @param fps           : the frame per second of the video
+ * @param low_freq      : the low frequence cut-off of the heart rate
+ * @param high_freq     : the high frequence cut-off of the heart rate
+ * @return              : the extractor, or nullptr if the name is unknown
+ */
+std::shared_ptr<SignalExtractor> createSignalExtractor(const std::string &name, int window_length, int fps = 30,
+                                                       double low_freq = 0.7, double high_freq = 4.0);
+
+#endif //SIGNAL_EXTRACTOR_H
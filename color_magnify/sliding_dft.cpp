@@ -0,0 +1,100 @@
+/**
+ * The sliding dft keeps the bins X(k) of the window for k in the passband only. When the window moves
+ * by one frame, the bins are updated by
+ *
+ * 		X'(k) = (X(k) + x_new - x_old) * e^(j*2*pi*k/N)
+ *
+ * and the filtered value of the newest frame is the inverse dft of the passband bins at the last
+ * position of the window, which is the sum of Re(X(k) + x_new - x_old) with the weight 2/N.
+ */
+
+#include "sliding_dft.h"
+
+void SlidingDFT::passbandBins(int _width, double _fl, double _fh, double _rate, int &_kl, int &_kh) {
+	int nyquist = _width / 2;
+
+	_kl = std::max(1, (int)std::ceil(_fl * _width / _rate));
+	_kh = std::min(nyquist, (int)std::floor(_fh * _width / _rate));
+
+	// the window is too short to hold a bin in the passband, use the nearest one to the center
+	if (_kl > _kh) {
+		int center = cvRound((_fl + _fh) * 0.5 * _width / _rate);
+		_kl = _kh = std::max(1, std::min(nyquist, center));
+	}
+}
+
+void SlidingDFT::init(int _samples, int _window, double _fl, double _fh, double _rate) {
+	int kh;
+	passbandBins(_window, _fl, _fh, _rate, kl_, kh);
+
+	samples_ = _samples;
+	window_ = _window;
+	bins_ = kh - kl_ + 1;
+
+	cos_.resize(bins_);
+	sin_.resize(bins_);
+	weight_.resize(bins_);
+	for (int b = 0; b < bins_; b++) {
+		int k = kl_ + b;
+		cos_[b] = std::cos(2 * CV_PI * k / window_);
+		sin_[b] = std::sin(2 * CV_PI * k / window_);
+		// the conjugate bin of a real signal doubles the weight, except for the nyquist bin
+		weight_[b] = (2 * k == window_ ? 1.0 : 2.0) / window_;
+	}
+
+	re_.assign((size_t)samples_ * bins_, 0.0);
+	im_.assign((size_t)samples_ * bins_, 0.0);
+}
+
+void SlidingDFT::update(const cv::Mat &_x_new, const cv::Mat &_x_old, cv::Mat &_y) {
+	_y.create(_x_new.size(), _x_new.type());
+
+	const float *x_new = _x_new.ptr<float>();
+	const float *x_old = _x_old.ptr<float>();
+	float *y = _y.ptr<float>();
+
+	std::vector<double> diff(samples_);
+	std::vector<double> sum(samples_, 0.0);
+	for (int i = 0; i < samples_; i++)
+		diff[i] = (double)x_new[i] - x_old[i];
+
+	for (int b = 0; b < bins_; b++) {
+		double c = cos_[b], s = sin_[b], w = weight_[b];
+		double *re = &re_[(size_t)b * samples_];
+		double *im = &im_[(size_t)b * samples_];
+
+		for (int i = 0; i < samples_; i++) {
+			double r = re[i] + diff[i];
+			double m = im[i];
+			sum[i] += w * r;
+			re[i] = r * c - m * s;
+			im[i] = r * s + m * c;
+		}
+	}
+
+	for (int i = 0; i < samples_; i++)
+		y[i] = (float)sum[i];
+}
+
+void SlidingDFT::resync(const PixelHistory &_history) {
+	std::fill(re_.begin(), re_.end(), 0.0);
+	std::fill(im_.begin(), im_.end(), 0.0);
+
+	// the unfilled slots are zero and older than the filled ones, so the window starts at the head slot
+	for (int m = 0; m < window_; m++) {
+		const float *x = _history.slot((_history.head() + m) % window_).ptr<float>();
+
+		for (int b = 0; b < bins_; b++) {
+			int k = kl_ + b;
+			double c = std::cos(2 * CV_PI * k * m / window_);
+			double s = std::sin(2 * CV_PI * k * m / window_);
+			double *re = &re_[(size_t)b * samples_];
+			double *im = &im_[(size_t)b * samples_];
+
+			for (int i = 0; i < samples_; i++) {
+				re[i] += x[i] * c;
+				im[i] -= x[i] * s;
+			}
+		}
+	}
+}
@@ -0,0 +1,75 @@
+#ifndef SLIDING_DFT_H
+#define SLIDING_DFT_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "pixel_history.h"
+
+
+/**
+ * SlidingDFT is used to temporal filter a group of time series with an ideal band-pass filter,
+ * when the window moves by one frame only the bins in the passband are updated
+ */
+class SlidingDFT {
+public:
+    SlidingDFT() {}
+    ~SlidingDFT() {}
+
+    /**
+     * init() is used to set the window and the passband, all the bins are set to zero
+     *
+     * @param samples       : the number of time series, which is the length of a planar slot of the history
+     * @param window        : the length of the window
+     * @param fl            : low frequence cut-off
+     * @param fh            : high frequence cut-off
+     * @param fps           : the frame per second of the video
+     */
+    void init(int samples, int window, double fl, double fh, double fps);
+
+    /**
+     * update() is used to slide the window of every time series by one frame
+     *
+     * @param x_new         : the frame entering the window, it should be continuous with samples elements
+     * @param x_old         : the frame leaving the window, it should be continuous with samples elements
+     * @param y             : output the filtered value of the entering frame, which has the same size of x_new
+     */
+    void update(const cv::Mat &x_new, const cv::Mat &x_old, cv::Mat &y);
+
+    /**
+     * resync() is used to recompute the bins from the window, which removes the rounding error of update()
+     *
+     * @param history       : the window, the oldest frame is in the head slot of the ring
+     */
+    void resync(const PixelHistory &history);
+
+    /**
+     * passbandBins() is used to find the dft bins between fl and fh of a window
+     *
+     * @param width         : the length of the window
+     * @param fl            : low frequence cut-off
+     * @param fh            : high frequence cut-off
+     * @param fps           : the frame per second of the video
+     * @param kl            : output the first bin of the passband
+     * @param kh            : output the last bin of the passband
+     */
+    static void passbandBins(int width, double fl, double fh, double fps, int &kl, int &kh);
+
+    int bins() const { return bins_; }
+
+private:
+    int samples_ = 0;
+    int window_ = 0;
+    int kl_ = 0;
+    int bins_ = 0;
+
+    //twiddle factor e^(j*2*pi*k/N) and the weight used to synthesize the newest frame for every bin
+    std::vector<double> cos_;
+    std::vector<double> sin_;
+    std::vector<double> weight_;
+
+    //the bins of every time series, samples * bins
+    std::vector<double> re_;
+    std::vector<double> im_;
+};
+
+#endif //SLIDING_DFT_H
@@ -1,11 +1,18 @@
 #include "color_magnify/color_magnify.h"
+#include "color_magnify/signal_extractor.h"
+#include "color_magnify/multi_face.h"
 #include "MTCNN/MTCNN.h"
+#include "MTCNN/MTCNNPool.h"
+#include "MTCNN/AsyncDetector.h"
+#include "MTCNN/LiteNet.h"
 #include "skcf/ktrackers.h"
 #include <opencv2/opencv.hpp>
 #include <stdio.h>
 #include <string.h>
 #include <iostream>
 #include <fstream>
+#include <deque>
+#include <map>
 
 using namespace std;
 using namespace cv;
@@ -70,6 +77,115 @@ using namespace cv;
 
 
 
+/**
+ * test main for the fused gaussian pyramid, benchmark against cv::pyrDown of every level
+ * @return
+ */
+//int main() {
+//
+//    VideoCapture video("result/face.mp4");
+//    Mat frame;
+//    video >> frame;
+//
+//    ColorMagnify color_magnify;
+//    color_magnify.set_fused_pyramid(true);
+//    int levels = 4;
+//    int rounds = 100;
+//
+//    for (auto size : {Size(1280, 720), Size(1920, 1080)}) {
+//        Mat src, reference, fused;
+//        resize(frame, src, size);
+//
+//        double time_profile_counter = cv::getCPUTickCount();
+//        for (int i = 0; i < rounds; i++) {
+//            src.convertTo(reference, CV_32FC3);
+//            for (int l = 0; l < levels; l++)
+//                pyrDown(reference, reference);
+//        }
+//        double reference_ms = (cv::getCPUTickCount() - time_profile_counter) / ((double)cvGetTickFrequency() * 1000) / rounds;
+//
+//        time_profile_counter = cv::getCPUTickCount();
+//        for (int i = 0; i < rounds; i++) {
+//            fused = color_magnify.buildGaussianPyramid(src, levels);
+//        }
+//        double fused_ms = (cv::getCPUTickCount() - time_profile_counter) / ((double)cvGetTickFrequency() * 1000) / rounds;
+//
+//        // the last rows and columns reflect the border once, so they are compared separately
+//        Rect inner(0, 0, fused.cols - 2, fused.rows - 2);
+//        double inner_error = norm(reference(inner), fused(inner), NORM_INF);
+//        double border_error = norm(reference, fused, NORM_INF);
+//
+//        std::cout << size << " pyrDown : " << reference_ms << "ms. fused : " << fused_ms << "ms. "
+//                  << "max error : " << inner_error << " (border " << border_error << ")" << std::endl;
+//    }
+//
+//    return 0;
+//}
+
+
+/**
+ * test main for the heart rate, only the bpm is estimated and no frame is reconstructed
+ * @return
+ */
+//int main() {
+//
+//    VideoCapture video("result/face.mp4");
+//    int fps = video.get(CV_CAP_PROP_FPS);
+//
+//    ColorMagnify color_magnify;
+//    color_magnify.set_stream(fps * 10, fps, 50.f, 0.83, 3.0, 4);
+//
+//    Mat frame;
+//    while (video.read(frame)) {
+//        auto heart_rate = color_magnify.push_heart_rate(frame);
+//        std::cout << "bpm : " << heart_rate.bpm << " confidence : " << heart_rate.confidence << std::endl;
+//    }
+//
+//    return 0;
+//}
+
+/**
+ * test main for the welch estimator, a segment of 4 seconds is pushed every hop and compared with the dft
+ * of a window of 20 seconds, which gives its first estimation after the whole window
+ * @return
+ */
+//int main() {
+//
+//    VideoCapture video("result/face.mp4");
+//    int fps = video.get(CV_CAP_PROP_FPS);
+//
+//    auto segment = createSignalExtractor("chrom", fps * 4, fps);
+//    auto window = createSignalExtractor("chrom", fps * 20, fps);
+//
+//    WelchEstimator welch;
+//    welch.init(fps * 4, fps, 0.7, 4.0);
+//
+//    Mat frame;
+//    vector<float> pulse;
+//    int frame_count = 0;
+//    while (video.read(frame)) {
+//        segment->push(frame, Rect());
+//        window->push(frame, Rect());
+//        frame_count++;
+//
+//        // one segment per hop once the first segment is filled
+//        if (frame_count >= welch.length() && (frame_count - welch.length()) % welch.hop() == 0 && segment->signal(pulse)) {
+//            auto heart_rate = welch.push_segment(pulse);
+//            std::cout << frame_count / (double)fps << "s. welch : " << heart_rate.bpm << " (" << heart_rate.confidence << ")";
+//            if (frame_count >= fps * 20) {
+//                auto reference = window->heart_rate();
+//                std::cout << " window : " << reference.bpm << " (" << reference.confidence << ")";
+//            }
+//            std::cout << std::endl;
+//        }
+//    }
+//
+//    std::cout << "welch first estimation : " << welch.stats().first_estimate_seconds << "s. over "
+//              << welch.stats().segments << " segments" << std::endl;
+//
+//    return 0;
+//}
+
 /**
  * test main for MTCNN
  * @return
@@ -111,51 +227,573 @@ using namespace cv;
 
 
 /**
- * test main for MTCNN and skcf
+ * test main for the packed and parallel scales of P-Net, benchmark against the forward of every scale
+ * @return
+ */
+//int main() {
+//
+//    MTCNN mtcnn;
+//
+//    VideoCapture video("result/face.mp4");
+//    Mat frame;
+//    video >> frame;
+//
+//    int rounds = 20;
+//
+//    for (auto size : {Size(1280, 720), Size(1920, 1080)}) {
+//        Mat src;
+//        resize(frame, src, size);
+//
+//        for (int mode = 0; mode < 3; mode++) {
+//            // the scales one by one, packed in one canvas, or on the replicas of P-Net at the same time
+//            mtcnn.set_pack_scales(mode == 1);
+//            mtcnn.set_P_Net_workers(mode == 2 ? std::thread::hardware_concurrency() : 1);
+//            vector<Rect> rectangles;
+//
+//            double time_profile_counter = cv::getCPUTickCount();
+//            for (int i = 0; i < rounds; i++) {
+//                mtcnn.bounding_box_.clear();
+//                mtcnn.confidence_.clear();
+//                mtcnn.Preprocess(src);
+//                mtcnn.P_Net();
+//            }
+//            double p_net_ms = (cv::getCPUTickCount() - time_profile_counter) / ((double)cvGetTickFrequency() * 1000) / rounds;
+//            size_t p_net_boxes = mtcnn.bounding_box_.size();
+//
+//            mtcnn.detection(src, rectangles);
+//
+//            std::cout << size << (mode == 0 ? " per scale" : mode == 1 ? " packed" : " parallel") << " P-Net : " << p_net_ms << "ms. "
+//                      << p_net_boxes << " boxes, " << rectangles.size() << " faces" << std::endl;
+//        }
+//    }
+//
+//    return 0;
+//}
+
+/**
+ * test main for the cascaded pyramid, the inputs of every scale of P-Net are resized from the octaves of the frame
+ * and compared with the inputs resized from the frame
+ * @return
+ */
+//int main() {
+//
+//    MTCNN mtcnn;
+//
+//    VideoCapture video("result/face.mp4");
+//    Mat frame, src;
+//    video >> frame;
+//    resize(frame, src, Size(1920, 1080));
+//
+//    int rounds = 20;
+//    vector<vector<float>> inputs[2];
+//
+//    for (int cascade = 0; cascade < 2; cascade++) {
+//        mtcnn.cascade_pyramid_ = cascade == 1;
+//
+//        double time_profile_counter = cv::getCPUTickCount();
+//        for (int i = 0; i < rounds; i++) {
+//            mtcnn.Preprocess(src);
+//            Rect whole(0, 0, mtcnn.img_size_.width, mtcnn.img_size_.height);
+//
+//            inputs[cascade].clear();
+//            for (auto &size : mtcnn.pyramid_sizes()) {
+//                vector<float> input(3 * size.area());
+//                mtcnn.fill_input(whole, Rect(Point(0, 0), size), input.data(), size);
+//                inputs[cascade].push_back(std::move(input));
+//            }
+//        }
+//        double resize_ms = (cv::getCPUTickCount() - time_profile_counter) / ((double)cvGetTickFrequency() * 1000) / rounds;
+//
+//        std::cout << (cascade ? "cascaded" : "from the frame") << " : " << resize_ms << "ms. for " << inputs[cascade].size() << " scales" << std::endl;
+//    }
+//
+//    // the difference of the inputs, which are normalized by 1 / 128
+//    for (size_t s = 0; s < inputs[0].size(); s++) {
+//        float worst = 0;
+//        for (size_t j = 0; j < inputs[0][s].size(); j++)
+//            worst = std::max(worst, std::abs(inputs[0][s][j] - inputs[1][s][j]));
+//        std::cout << "scale " << s << " : the largest difference is " << worst * 128 << " levels of gray" << std::endl;
+//    }
+//
+//    return 0;
+//}
+
+
+/**
+ * test main for the concurrent streams, every stream detects in its own thread against one loaded model
+ * @return
+ */
+//int main() {
+//
+//    auto model = std::make_shared<MTCNNModel>();
+//    MTCNNPool pool(model);
+//
+//    vector<string> streams = {"result/face.mp4", "result/face.mp4", "result/face.mp4", "result/face.mp4"};
+//    vector<std::thread> threads;
+//    for (auto stream : streams) {
+//        threads.push_back(std::thread([&pool, stream]() {
+//            VideoCapture video(stream);
+//            Mat frame;
+//            int faces = 0;
+//            while (video.read(frame)) {
+//                vector<Rect> rectangles;
+//                pool.detection(frame, rectangles);
+//                faces += rectangles.size();
+//            }
+//            std::cout << stream << " : " << faces << " faces" << std::endl;
+//        }));
+//    }
+//
+//    for (auto &thread : threads) {
+//        thread.join();
+//    }
+//    std::cout << pool.workspaces() << " workspaces for " << streams.size() << " streams" << std::endl;
+//
+//    return 0;
+//}
+
+/**
+ * test main for the row-major nets, the faces of every frame of the video are compared with the transposed nets
+ * @return
+ */
+//int main() {
+//
+//    // the weights as they were trained and the weights changed to the row-major images
+//    MTCNN transposed(std::make_shared<MTCNNModel>(false));
+//    MTCNN row_major(std::make_shared<MTCNNModel>(true));
+//
+//    VideoCapture video("result/face.mp4");
+//    Mat frame;
+//
+//    int frames = 0, mismatches = 0;
+//    float worst_confidence = 0, worst_corner = 0;
+//    while (video.read(frame)) {
+//        vector<Rect> expected, rectangles;
+//        vector<float> expected_confidence, confidence;
+//        transposed.detection(frame, expected, expected_confidence);
+//        row_major.detection(frame, rectangles, confidence);
+//
+//        // the order of the faces is the order of the confidence, the sums of the convolutions are in another order
+//        // so the faces are the same up to the rounding
+//        bool same = expected.size() == rectangles.size();
+//        for (size_t i = 0; same && i < expected.size(); i++) {
+//            float corner = std::max(std::max(std::abs(expected[i].x - rectangles[i].x), std::abs(expected[i].y - rectangles[i].y)),
+//                                    std::max(std::abs(expected[i].br().x - rectangles[i].br().x), std::abs(expected[i].br().y - rectangles[i].br().y)));
+//            worst_corner = std::max(worst_corner, corner);
+//            worst_confidence = std::max(worst_confidence, std::abs(expected_confidence[i] - confidence[i]));
+//            same = corner <= 1;
+//        }
+//
+//        mismatches += !same;
+//        frames++;
+//    }
+//
+//    std::cout << frames << " frames, " << mismatches << " mismatches, the largest difference of a corner is " << worst_corner
+//              << " pixels and of a confidence is " << worst_confidence << std::endl;
+//
+//    return mismatches == 0 ? 0 : -1;
+//}
+
+/**
+ * test main for LiteNet, the outputs of P, R and O net are compared with Caffe on the same random inputs,
+ * which needs the build with Caffe, USE_LITENET is off
+ * @return
+ */
+//int main() {
+//
+//    const char *models[] = {"./MTCNN/model/det1", "./MTCNN/model/det2", "./MTCNN/model/det3"};
+//    const int shapes[][4] = {{1, 3, 480, 640}, {64, 3, 24, 24}, {16, 3, 48, 48}};
+//
+//    Caffe::set_mode(Caffe::CPU);
+//    RNG rng;
+//    int failures = 0;
+//    for (int i = 0; i < 3; i++) {
+//        string prototxt = string(models[i]) + ".prototxt", caffemodel = string(models[i]) + ".caffemodel";
+//        caffe::Net<float> expected(prototxt, caffe::TEST);
+//        litenet::Net<float> lite(prototxt, litenet::TEST);
+//        expected.CopyTrainedLayersFrom(caffemodel);
+//        lite.CopyTrainedLayersFrom(caffemodel);
+//
+//        const int *shape = shapes[i];
+//        expected.input_blobs()[0]->Reshape(shape[0], shape[1], shape[2], shape[3]);
+//        lite.input_blobs()[0]->Reshape(shape[0], shape[1], shape[2], shape[3]);
+//        expected.Reshape();
+//        lite.Reshape();
+//
+//        // the inputs of MTCNN are in [-1, 1]
+//        Mat input(1, expected.input_blobs()[0]->count(), CV_32FC1, expected.input_blobs()[0]->mutable_cpu_data());
+//        rng.fill(input, RNG::UNIFORM, -1, 1);
+//        input.copyTo(Mat(1, lite.input_blobs()[0]->count(), CV_32FC1, lite.input_blobs()[0]->mutable_cpu_data()));
+//
+//        // the first forward of LiteNet packs the weights, so both are timed on the second one
+//        expected.Forward();
+//        lite.Forward();
+//        double start = (double)getTickCount();
+//        expected.Forward();
+//        double caffe_time = ((double)getTickCount() - start) / getTickFrequency() * 1000;
+//        start = (double)getTickCount();
+//        lite.Forward();
+//        double lite_time = ((double)getTickCount() - start) / getTickFrequency() * 1000;
+//
+//        for (size_t k = 0; k < expected.output_blobs().size(); k++) {
+//            const float *a = expected.output_blobs()[k]->cpu_data(), *b = lite.output_blobs()[k]->cpu_data();
+//            float worst = 0;
+//            for (int j = 0; j < expected.output_blobs()[k]->count(); j++)
+//                worst = std::max(worst, std::abs(a[j] - b[j]));
+//            failures += worst > 1e-4f;
+//            std::cout << models[i] << " output " << k << " the largest difference is " << worst << std::endl;
+//        }
+//        std::cout << models[i] << " caffe " << caffe_time << " ms, litenet " << lite_time << " ms" << std::endl;
+//    }
+//
+//    return failures == 0 ? 0 : -1;
+//}
+
+/**
+ * test main for the int8 R-Net and O-Net, which are calibrated on the first half of the video and compared with the
+ * float nets on the second half, which needs the build with USE_LITENET
+ * @return
+ */
+//int main() {
+//
+//    VideoCapture video("result/face.mp4");
+//    vector<Mat> frames;
+//    Mat frame;
+//    while (video.read(frame))
+//        frames.push_back(frame.clone());
+//    size_t half = frames.size() / 2;
+//
+//    auto model = std::make_shared<MTCNNModel>();
+//    if (!MTCNN::quantize(model, vector<Mat>(frames.begin(), frames.begin() + half)))
+//        std::cout << "Some layers are kept in float" << std::endl;
+//    MTCNN float_nets;
+//    MTCNN int8_nets(model);
+//
+//    int faces = 0, missed = 0, extra = 0;
+//    double overlap = 0, float_time = 0, int8_time = 0;
+//    float worst_confidence = 0;
+//    for (size_t f = half; f < frames.size(); f++) {
+//        vector<Rect> expected, rectangles;
+//        vector<float> expected_confidence, confidence;
+//        double start = (double)getTickCount();
+//        float_nets.detection(frames[f], expected, expected_confidence);
+//        float_time += ((double)getTickCount() - start) / getTickFrequency() * 1000;
+//        start = (double)getTickCount();
+//        int8_nets.detection(frames[f], rectangles, confidence);
+//        int8_time += ((double)getTickCount() - start) / getTickFrequency() * 1000;
+//
+//        // every face of the float nets is matched with the int8 face of the largest IoU
+//        vector<bool> matched(rectangles.size(), false);
+//        for (size_t i = 0; i < expected.size(); i++) {
+//            int best = -1;
+//            float best_iou = 0.5f;
+//            for (size_t j = 0; j < rectangles.size(); j++) {
+//                int intersection = (expected[i] & rectangles[j]).area();
+//                float iou = intersection / (float)(expected[i].area() + rectangles[j].area() - intersection);
+//                if (!matched[j] && iou > best_iou) {
+//                    best = j;
+//                    best_iou = iou;
+//                }
+//            }
+//
+//            faces++;
+//            if (best < 0) {
+//                missed++;
+//                continue;
+//            }
+//            matched[best] = true;
+//            overlap += best_iou;
+//            worst_confidence = std::max(worst_confidence, std::abs(expected_confidence[i] - confidence[best]));
+//        }
+//        extra += std::count(matched.begin(), matched.end(), false);
+//    }
+//
+//    int count = std::max<int>(1, frames.size() - half);
+//    std::cout << faces << " faces of the float nets, " << missed << " missed and " << extra << " extra by the int8 nets" << std::endl;
+//    std::cout << "the mean IoU of the matched faces is " << overlap / std::max(1, faces - missed)
+//              << " and the largest difference of a confidence is " << worst_confidence << std::endl;
+//    std::cout << "float " << float_time / count << " ms, int8 " << int8_time / count << " ms per frame" << std::endl;
+//
+//    return 0;
+//}
+
+/**
+ * test main for the packed model file, the startup and the faces are compared with the caffe models, which needs
+ * the build with USE_LITENET and the file of "pack_model result/mtcnn.lnet"
+ * @return
+ */
+//int main() {
+//
+//    double start = (double)getTickCount();
+//    auto caffe_model = std::make_shared<MTCNNModel>();
+//    MTCNN caffe_nets(caffe_model);
+//    double caffe_time = ((double)getTickCount() - start) / getTickFrequency() * 1000;
+//
+//    start = (double)getTickCount();
+//    auto packed_model = std::make_shared<MTCNNModel>("result/mtcnn.lnet");
+//    MTCNN packed_nets(packed_model);
+//    double packed_time = ((double)getTickCount() - start) / getTickFrequency() * 1000;
+//
+//    std::cout << "startup of the caffe models " << caffe_time << " ms, of the packed file " << packed_time << " ms" << std::endl;
+//
+//    VideoCapture video("result/face.mp4");
+//    Mat frame;
+//    int frames = 0, mismatches = 0;
+//    while (video.read(frame)) {
+//        vector<Rect> expected, rectangles;
+//        caffe_nets.detection(frame, expected);
+//        packed_nets.detection(frame, rectangles);
+//        mismatches += expected != rectangles;
+//        frames++;
+//    }
+//    std::cout << frames << " frames, " << mismatches << " mismatches" << std::endl;
+//
+//    return mismatches == 0 ? 0 : -1;
+//}
+
+/**
+ * test main for the threaded loading of the nets, the constructor of the model returns when P-Net is loaded,
+ * the first detection waits for R-Net and O-Net
  * @return
  */
+//int main() {
+//
+//    VideoCapture video("result/face.mp4");
+//    Mat frame;
+//    video.read(frame);
+//
+//    double start = (double)getTickCount();
+//    auto model = std::make_shared<MTCNNModel>();
+//    double model_time = ((double)getTickCount() - start) / getTickFrequency() * 1000;
+//
+//    MTCNN detector(model);
+//    vector<Rect> rectangles;
+//    detector.detection(frame, rectangles);
+//    double first_time = ((double)getTickCount() - start) / getTickFrequency() * 1000;
+//
+//    vector<double> load_times = model->load_times();
+//    std::cout << "model " << model_time << " ms, first detection " << first_time << " ms, "
+//              << rectangles.size() << " faces" << std::endl;
+//    for (int i = 0; i < load_times.size(); i++)
+//        std::cout << "net " << i << " loaded in " << load_times[i] << " ms" << std::endl;
+//
+//    return 0;
+//}
+
+
+/**
+ * the state of a tracked face, the tracked areas are kept since the frame in the detector
+ */
+struct FaceTrack {
+    std::shared_ptr<KTrackers> tracker;
+    std::map<int, Rect> history;
+    Rect face;
+    std::shared_ptr<SignalExtractor> extractor;
+    int slot = -1;
+    bool started = false;
+};
+
+/**
+ * reconcile() is used to move the faces detected in an older frame to the current frame. A face on a track of
+ * the detected frame is shifted by the motion of this track since then, a new face is tracked through the
+ * frames since then. The tracks without a face are dropped
+ *
+ * @param tracks        : the tracks, which have tracked the frames before the current one
+ * @param rectangles    : the faces detected in the older frame, in the coordinate of the input frame
+ * @param detected      : the id of the detected frame
+ * @param recent        : the resized frames since the detected frame
+ * @param scale_factor  : the scale of the resized frames
+ */
+void reconcile(vector<FaceTrack> &tracks, const vector<Rect> &rectangles, int detected,
+               const std::deque<std::pair<int, Mat>> &recent, float scale_factor) {
+    vector<FaceTrack> updated;
+    vector<bool> matched(tracks.size(), false);
+
+    for (auto rect : rectangles) {
+        Rect area((rect.x - rect.width * scale_factor * 0.2) * scale_factor,
+                  (rect.y - rect.height * scale_factor * 0.2) * scale_factor,
+                  rect.width * scale_factor * 1.4, rect.height * scale_factor * 1.4);
+
+        // the track which was on this face in the detected frame
+        int best = -1;
+        float best_overlap = 0.3f;
+        for (size_t i = 0; i < tracks.size(); i++) {
+            auto then = tracks[i].history.find(detected);
+            if (matched[i] || then == tracks[i].history.end())
+                continue;
+            float overlap = (area & then->second).area() / (float)(area | then->second).area();
+            if (overlap > best_overlap) {
+                best = i;
+                best_overlap = overlap;
+            }
+        }
+
+        if (best >= 0) {
+            FaceTrack track = tracks[best];
+            matched[best] = true;
+
+            // the motion of the tracker from the detected frame to the last frame
+            Rect then = track.history[detected];
+            Rect last = track.history.rbegin()->second;
+            int shift_x = (last.x + last.width / 2) - (then.x + then.width / 2);
+            int shift_y = (last.y + last.height / 2) - (then.y + then.height / 2);
+
+            track.tracker->set_area(Rect(area.x + shift_x, area.y + shift_y, area.width, area.height));
+            updated.push_back(track);
+        } else {
+            FaceTrack track;
+            track.tracker = std::make_shared<KTrackers>(false);
+            track.tracker->set_area(area);
+            for (auto &frame : recent) {
+                if (frame.first >= detected)
+                    track.history[frame.first] = track.tracker->get_area(frame.second);
+            }
+            updated.push_back(track);
+        }
+    }
 
-int main() {
+    tracks.swap(updated);
+}
 
-    MTCNN mtcnn;
 
+/**
+ * test main for MTCNN and skcf, the heart rate of every face is estimated by the extractor named by
+ * the first argument, which is "green", "chrom", "pos" or "evm". The mean color methods of all the faces
+ * are estimated in one batch by MultiFaceEngine. The faces are detected in the background, the trackers
+ * keep going meanwhile and the detected faces are moved to the current frame when they arrive. The detection
+ * searches around the tracked faces only, except a sweep of the whole frame every few seconds
+ * @return
+ */
+
+int main(int argc, char **argv) {
+
+    double start = (double)getTickCount();
 
     VideoCapture cap(0);
 	int fps = cap.get(CV_CAP_PROP_FPS);
 
+    // R-Net and O-Net are still loading when the capture starts
+    auto model = std::make_shared<MTCNNModel>();
+    AsyncDetector detector(model, Size(cap.get(CV_CAP_PROP_FRAME_WIDTH), cap.get(CV_CAP_PROP_FRAME_HEIGHT)));
+    bool first_detection = true;
+
+    string method = argc > 1 ? argv[1] : "chrom";
+    bool batched = method == "green" || method == "chrom";
+    if (!batched && !createSignalExtractor(method, fps * 10, fps)) {
+        return -1;
+    }
+
+    MultiFaceEngine engine;
+    engine.init(32, fps * 10, fps, 0.7, 4.0,
+                method == "green" ? MultiFaceEngine::GREEN_PULSE : MultiFaceEngine::CHROM_PULSE);
+
     Mat img;
 
-    vector<std::shared_ptr<KTrackers>> kcfs;
+    vector<FaceTrack> tracks;
+
+    // the resized frames since the frame in the detector
+    std::deque<std::pair<int, Mat>> recent;
 
     float scale_factor = 0.15;
+    int full_sweep_seconds = 5;
 
     int frame_count = 0;
     while(cap.read(img))
     {
-        if(frame_count % fps == 0 || kcfs.size() == 0){
-            vector<Rect> rectangles;
-            rectangles.clear();
-            kcfs.clear();
-            mtcnn.detection(img, rectangles);
-
-            for(auto rect : rectangles) {
-                rect = cv::Rect((rect.x - rect.width * scale_factor * 0.2) * scale_factor, 
-                                (rect.y - rect.height * scale_factor * 0.2) * scale_factor,
-                                rect.width * scale_factor * 1.4, rect.height * scale_factor * 1.4);
-                auto skcf = std::make_shared<KTrackers>(false);
-                skcf->set_area(rect);
-                kcfs.push_back(skcf);
-            }
-        }
-
         cv::Mat resized;
         resize(img, resized, cv::Size(0, 0), scale_factor, scale_factor);
 
         double time_profile_counter = cv::getCPUTickCount();
-        for(auto skcf : kcfs) {
-            auto rect = skcf->get_area(resized);
-            rect = cv::Rect(rect.x / scale_factor, rect.y / scale_factor, rect.width / scale_factor, rect.height / scale_factor);
-            cv::rectangle(img, rect, cv::Scalar(0, 255, 0), 3);
+
+        // the faces of an older frame, moved to the frame before this one
+        vector<Rect> rectangles;
+        int detected;
+        if (detector.poll(rectangles, detected)) {
+            reconcile(tracks, rectangles, detected, recent, scale_factor);
+
+            if (first_detection) {
+                first_detection = false;
+                vector<double> load_times = model->load_times();
+                std::cout << "first detection in " << ((double)getTickCount() - start) / getTickFrequency() * 1000
+                          << " ms, the nets loaded in";
+                for (double load_time : load_times)
+                    std::cout << " " << load_time;
+                std::cout << " ms" << std::endl;
+            }
+        }
+
+        // the faces are searched around the tracks every second, and in the whole frame for the new faces
+        // every few seconds
+        if (frame_count % fps == 0 || tracks.size() == 0) {
+            vector<Rect> regions;
+            for (auto &track : tracks) {
+                if (frame_count % (fps * full_sweep_seconds) != 0 && track.face.area() > 0)
+                    regions.push_back(track.face);
+            }
+            if (detector.submit(img, frame_count, regions)) {
+                recent.clear();
+                for (auto &track : tracks) {
+                    track.history.clear();
+                }
+            }
+        }
+        if (detector.busy()) {
+            recent.push_back(std::make_pair(frame_count, resized));
+        }
+
+        // a new track takes a free place of the engine, or its own extractor
+        for (auto &track : tracks) {
+            if (track.started)
+                continue;
+            track.started = true;
+            if (!batched) {
+                track.extractor = createSignalExtractor(method, fps * 10, fps);
+                continue;
+            }
+            for (int slot = 0; slot < engine.max_faces() && track.slot < 0; slot++) {
+                bool used = false;
+                for (auto &other : tracks)
+                    used = used || other.slot == slot;
+                if (!used) {
+                    track.slot = slot;
+                    engine.reset_face(slot);
+                }
+            }
+        }
+
+        vector<Rect> faces(tracks.size());
+        vector<HeartRate> heart_rates(tracks.size());
+        vector<Rect> slots(engine.max_faces());
+        for(size_t i = 0; i < tracks.size(); i++) {
+            auto rect = tracks[i].tracker->get_area(resized);
+            if (detector.busy()) {
+                tracks[i].history[frame_count] = rect;
+            }
+            faces[i] = cv::Rect(rect.x / scale_factor, rect.y / scale_factor, rect.width / scale_factor, rect.height / scale_factor);
+            tracks[i].face = faces[i];
+
+            if (tracks[i].extractor) {
+                tracks[i].extractor->push(img, faces[i]);
+                heart_rates[i] = tracks[i].extractor->heart_rate();
+            } else if (tracks[i].slot >= 0) {
+                slots[tracks[i].slot] = faces[i];
+            }
+        }
+
+        if (batched) {
+            vector<HeartRate> slot_rates;
+            engine.push(img, slots);
+            engine.estimate(slot_rates);
+            for (size_t i = 0; i < tracks.size(); i++) {
+                if (tracks[i].slot >= 0 && tracks[i].slot < slot_rates.size())
+                    heart_rates[i] = slot_rates[tracks[i].slot];
+            }
+        }
+
+        for(size_t i = 0; i < faces.size(); i++) {
+            cv::rectangle(img, faces[i], cv::Scalar(0, 255, 0), 3);
+            cv::putText(img, std::to_string((int)heart_rates[i].bpm) + " bpm", faces[i].tl(),
+                        cv::FONT_HERSHEY_COMPLEX_SMALL, 0.8, cvScalar(0, 255, 0), 1, CV_AA);
         }
         time_profile_counter = cv::getCPUTickCount() - time_profile_counter;
         std::cout << "  -> speed : " <<  time_profile_counter/((double)cvGetTickFrequency()*1000) << "ms. per frame" << std::endl;